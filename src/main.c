@@ -5,8 +5,10 @@
 
 #include <ctype.h>
 #include <float.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 static void usage(const char *exe_name) {
@@ -15,7 +17,12 @@ static void usage(const char *exe_name) {
   if (rank == 0) {
     fprintf(stderr, "%s: no input file specified!\n", exe_name);
     fprintf(stderr, "%s: usage:\n", exe_name);
-    fprintf(stderr, "%s <input.yaml>\n", exe_name);
+    fprintf(stderr, "%s [--estimate] <input.yaml> [PETSc options]\n",
+            exe_name);
+    fprintf(stderr, "  --estimate: predict mesh sizes and resource usage"
+                    " without meshing\n");
+    fprintf(stderr, "  PETSc options (e.g. -petscpartitioner_type parmetis)"
+                    " follow the input file\n");
   }
   exit(1);
 }
@@ -24,6 +31,37 @@ static void shutdown(void) {
   PetscFinalize();
 }
 
+// Prints a resource estimate in a human-readable form.
+static void print_estimate(tdm_estimate_t estimate) {
+  const char *stage_names[TDM_NUM_STAGES] = {
+    "read data", "triangulate", "extrude", "write meshes"
+  };
+  PetscPrintf(PETSC_COMM_WORLD, "Input raster: %zd x %zd (%zd masked points)\n",
+              estimate.num_rows, estimate.num_cols, estimate.num_masked_points);
+  PetscPrintf(PETSC_COMM_WORLD, "Surface mesh: ~%zd vertices, ~%zd triangles\n",
+              estimate.num_surface_vertices, estimate.num_surface_triangles);
+  PetscPrintf(PETSC_COMM_WORLD, "Column mesh:  ~%zd prisms\n",
+              estimate.num_column_cells);
+  PetscPrintf(PETSC_COMM_WORLD, "%-14s %14s %12s\n", "Stage",
+              "Memory [MiB]", "Time [s]");
+  for (int s = 0; s < TDM_NUM_STAGES; ++s) {
+    PetscPrintf(PETSC_COMM_WORLD, "%-14s %14.1f %12.1f\n", stage_names[s],
+                estimate.stage_memory[s] / 1048576.0, estimate.stage_time[s]);
+  }
+  PetscPrintf(PETSC_COMM_WORLD, "%-14s %14.1f %12.1f\n", "peak/total",
+              estimate.peak_memory / 1048576.0, estimate.total_time);
+  PetscPrintf(PETSC_COMM_WORLD, "Recommended number of ranks: %d "
+              "(%.1f MiB per rank)\n", estimate.num_ranks,
+              estimate.rank_memory / 1048576.0);
+  if (estimate.serial_memory > estimate.memory_per_rank) {
+    PetscPrintf(PETSC_COMM_WORLD, "Warning: reading, triangulating, and "
+                "extruding need %.1f MiB on every rank, more than the %.1f MiB "
+                "assumed available, however many ranks are used.\n",
+                estimate.serial_memory / 1048576.0,
+                estimate.memory_per_rank / 1048576.0);
+  }
+}
+
 #define CHECK_ERROR(result) \
   if (result.err_code) { \
     fprintf(stderr, "%s: %s\n", argv[0], result.err_msg); \
@@ -32,30 +70,63 @@ static void shutdown(void) {
 
 
 int main(int argc, char **argv) {
-  // Fire up PETSc.
-  PetscInitializeNoArguments();
+  // Fire up PETSc, passing along any options it recognizes.
+  PetscInitialize(&argc, &argv, NULL, NULL);
   atexit(shutdown);
 
-  // Parse command line args.
-  if (argc < 2) {
+  // Parse command line args. Everything from the first PETSc option onward
+  // (including option values) belongs to PETSc.
+  const char *yaml_file = NULL;
+  bool estimate_only = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--estimate")) {
+      estimate_only = true;
+    } else if (argv[i][0] == '-') {
+      break;
+    } else if (!yaml_file) {
+      yaml_file = argv[i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (!yaml_file) {
     usage(argv[0]);
   }
 
-  const char *yaml_file = argv[1];
-  tdm_config_t config;
+  tdm_config_t config = {};
   tdm_result_t result = read_yaml(yaml_file, &config);
   CHECK_ERROR(result);
 
+  // If we're only estimating resources, do so and bail.
+  if (estimate_only) {
+    tdm_estimate_t estimate;
+    result = estimate_resources(config, &estimate);
+    CHECK_ERROR(result);
+    print_estimate(estimate);
+    return 0;
+  }
+
   // Extract point information from the specified configuration.
   point_t *points;
   size_t num_points;
   result = extract_points(config, &num_points, &points);
+  CHECK_ERROR(result);
 
   // Generate a triangulation from the point data and config options.
   DM surface_mesh;
   result = triangulate_dem(config, num_points, points, &surface_mesh);
   CHECK_ERROR(result);
 
+  // If requested, coarsen the triangulation wherever the terrain allows it.
+  if (config.decimation_max_error > 0.0) {
+    DM decimated_mesh;
+    result = decimate_surface_mesh(config, num_points, points, surface_mesh,
+                                   &decimated_mesh);
+    CHECK_ERROR(result);
+    DMDestroy(&surface_mesh);
+    surface_mesh = decimated_mesh;
+  }
+
   // Write the triangle (surface) mesh to an appropriate format.
   result = write_mesh(config, surface_mesh, "surface_mesh");
   CHECK_ERROR(result);
@@ -65,6 +136,24 @@ int main(int argc, char **argv) {
   result = extrude_surface_mesh(config, surface_mesh, &column_mesh);
   CHECK_ERROR(result);
 
+  // If requested, partition the column mesh for the target number of ranks.
+  if (config.num_ranks > 0) {
+    result = partition_column_mesh(config, num_points, points, surface_mesh,
+                                   column_mesh);
+    CHECK_ERROR(result);
+  }
+
+  // If we're running in parallel, distribute the column mesh among our ranks
+  // without splitting its columns.
+  DM distributed_mesh;
+  result = distribute_column_mesh(config, num_points, points, surface_mesh,
+                                  column_mesh, &distributed_mesh);
+  CHECK_ERROR(result);
+  if (distributed_mesh) {
+    DMDestroy(&column_mesh);
+    column_mesh = distributed_mesh;
+  }
+
   // Write the column mesh to an appropriate format
   result = write_mesh(config, column_mesh, "column_mesh");
   CHECK_ERROR(result);
@@ -0,0 +1,102 @@
+#include "point_grid.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void tdm_point_grid_bucket(const tdm_point_grid_t *grid,
+                           real_t x, real_t y,
+                           size_t *i, size_t *j) {
+  real_t fi = floor((x - grid->x0) / grid->dx),
+         fj = floor((y - grid->y0) / grid->dy);
+  *i = (fi < 0.0) ? 0 : (fi >= grid->nx) ? grid->nx - 1 : (size_t)fi;
+  *j = (fj < 0.0) ? 0 : (fj >= grid->ny) ? grid->ny - 1 : (size_t)fj;
+}
+
+void tdm_point_grid_build(size_t            num_points,
+                          const point_t     points[num_points],
+                          tdm_point_grid_t *grid) {
+  real_t min_x = FLT_MAX, max_x = -FLT_MAX, min_y = FLT_MAX, max_y = -FLT_MAX;
+  for (size_t p = 0; p < num_points; ++p) {
+    if (min_x > points[p].x) min_x = points[p].x;
+    if (max_x < points[p].x) max_x = points[p].x;
+    if (min_y > points[p].y) min_y = points[p].y;
+    if (max_y < points[p].y) max_y = points[p].y;
+  }
+  real_t lx = (max_x > min_x) ? max_x - min_x : 1.0,
+         ly = (max_y > min_y) ? max_y - min_y : 1.0;
+  real_t h = sqrt(lx * ly / ((num_points > 0) ? num_points : 1));
+  grid->x0 = min_x;
+  grid->y0 = min_y;
+  grid->nx = (size_t)ceil(lx / h);
+  grid->ny = (size_t)ceil(ly / h);
+  if (grid->nx == 0) grid->nx = 1;
+  if (grid->ny == 0) grid->ny = 1;
+  grid->dx = lx / grid->nx;
+  grid->dy = ly / grid->ny;
+
+  // Counting sort of points by bucket.
+  size_t num_buckets = grid->nx * grid->ny;
+  grid->offsets = calloc(num_buckets + 1, sizeof(size_t));
+  grid->indices = malloc(sizeof(size_t) * (num_points + 1));
+  size_t *buckets = malloc(sizeof(size_t) * (num_points + 1));
+  for (size_t p = 0; p < num_points; ++p) {
+    size_t i, j;
+    tdm_point_grid_bucket(grid, points[p].x, points[p].y, &i, &j);
+    buckets[p] = j * grid->nx + i;
+    ++grid->offsets[buckets[p]+1];
+  }
+  for (size_t b = 0; b < num_buckets; ++b) {
+    grid->offsets[b+1] += grid->offsets[b];
+  }
+  size_t *pos = malloc(sizeof(size_t) * (num_buckets + 1));
+  memcpy(pos, grid->offsets, sizeof(size_t) * num_buckets);
+  for (size_t p = 0; p < num_points; ++p) {
+    grid->indices[pos[buckets[p]]++] = p;
+  }
+  free(pos);
+  free(buckets);
+}
+
+// We search rings of buckets outward from the one containing (x, y) until no
+// closer point can exist.
+size_t tdm_point_grid_nearest(const tdm_point_grid_t *grid,
+                              const point_t           points[],
+                              real_t x, real_t y) {
+  size_t ci, cj;
+  tdm_point_grid_bucket(grid, x, y, &ci, &cj);
+  size_t nearest = 0;
+  real_t min_dist2 = FLT_MAX;
+  real_t h = (grid->dx < grid->dy) ? grid->dx : grid->dy;
+  size_t max_ring = (grid->nx > grid->ny) ? grid->nx : grid->ny;
+  for (size_t r = 0; r <= max_ring; ++r) {
+    // Points outside this ring are at least (r-1)*h away.
+    if ((r > 1) && ((r-1) * h * (r-1) * h > min_dist2)) break;
+    size_t i0 = (ci > r) ? ci - r : 0, i1 = ci + r,
+           j0 = (cj > r) ? cj - r : 0, j1 = cj + r;
+    for (size_t j = j0; (j <= j1) && (j < grid->ny); ++j) {
+      for (size_t i = i0; (i <= i1) && (i < grid->nx); ++i) {
+        if ((i + r != ci) && (i != ci + r) && (j + r != cj) && (j != cj + r)) {
+          continue; // interior of the ring, already searched
+        }
+        size_t b = j * grid->nx + i;
+        for (size_t k = grid->offsets[b]; k < grid->offsets[b+1]; ++k) {
+          const point_t *p = &points[grid->indices[k]];
+          real_t dist2 = (p->x - x) * (p->x - x) + (p->y - y) * (p->y - y);
+          if (dist2 < min_dist2) {
+            min_dist2 = dist2;
+            nearest = grid->indices[k];
+          }
+        }
+      }
+    }
+  }
+  return nearest;
+}
+
+void tdm_point_grid_destroy(tdm_point_grid_t *grid) {
+  if (grid->offsets) free(grid->offsets);
+  if (grid->indices) free(grid->indices);
+  *grid = (tdm_point_grid_t){0};
+}
@@ -0,0 +1,37 @@
+#ifndef TDM_POINT_GRID_H
+#define TDM_POINT_GRID_H
+
+#include "tdm.h"
+
+// A tdm_point_grid_t sorts points into a uniform grid of buckets in the x-y
+// plane so we can quickly find points near a given location. The grid stores
+// only the indices of the points, so the points themselves must outlive it.
+typedef struct tdm_point_grid_t {
+  real_t  x0, y0, dx, dy; // origin and bucket spacing
+  size_t  nx, ny;         // numbers of buckets in x and y
+  size_t *offsets;        // [nx*ny+1] offsets of buckets in indices
+  size_t *indices;        // indices of points, sorted by bucket
+} tdm_point_grid_t;
+
+// Sorts the given points into a grid with about one point per bucket.
+void tdm_point_grid_build(size_t            num_points,
+                          const point_t     points[num_points],
+                          tdm_point_grid_t *grid);
+
+// Computes the coordinates (i, j) of the bucket containing the given location,
+// clamped to the grid, so bucket j * grid->nx + i holds the indices
+// grid->indices[grid->offsets[b]] through grid->indices[grid->offsets[b+1]-1].
+void tdm_point_grid_bucket(const tdm_point_grid_t *grid,
+                           real_t x, real_t y,
+                           size_t *i, size_t *j);
+
+// Returns the index of the point in the grid nearest to (x, y) in the x-y
+// plane, or 0 if the grid is empty.
+size_t tdm_point_grid_nearest(const tdm_point_grid_t *grid,
+                              const point_t           points[],
+                              real_t x, real_t y);
+
+// Frees the resources allocated to the given grid.
+void tdm_point_grid_destroy(tdm_point_grid_t *grid);
+
+#endif
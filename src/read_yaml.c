@@ -27,6 +27,14 @@ typedef struct parser_state_t {
   bool parsing_surface_mesh_output;
   bool parsing_column_mesh_output;
   khash_t(yaml_name_set) *output_param_names;
+  khash_t(yaml_name_set) *surface_mesh_param_names;
+  khash_t(yaml_name_set) *column_mesh_param_names;
+
+  bool parsing_partitioning;
+  khash_t(yaml_name_set) *partitioning_param_names;
+
+  bool parsing_decimation;
+  khash_t(yaml_name_set) *decimation_param_names;
 
   char current_param[128];
 } parser_state_t;
@@ -43,14 +51,15 @@ static tdm_result_t check_param_name(const char             *block_name,
                       param_name, block_name);
   }
 
-  // Is the name valid?
+  // Is the name valid? (valid_names is NULL-terminated)
   const char **which = valid_names;
   while (*which) {
     if (!strcmp(param_name, *which)) break;
+    ++which;
   }
   if (!*which) {
     return tdm_result(1, "Invalid parameter name in %s block: '%s'",
-                      param_name, block_name);
+                      block_name, param_name);
   }
 
   // Add this parameter name to our set of tracked names.
@@ -80,7 +89,8 @@ static tdm_result_t parse_data_param(parser_state_t *state,
 static tdm_result_t parse_int32(const char *str, int32_t *value) {
   char *endptr;
   long v = strtol(str, &endptr, 10);
-  if (endptr) {
+  if ((endptr == str) || (*endptr != '\0') || (v < INT32_MIN) ||
+      (v > INT32_MAX)) {
     return tdm_result(1, "Invalid integer value: %s", str);
   }
   *value = v;
@@ -91,13 +101,27 @@ static tdm_result_t parse_int32(const char *str, int32_t *value) {
 static tdm_result_t parse_real(const char *str, real_t *value) {
   char *endptr;
   double v = strtod(str, &endptr);
-  if (endptr) {
+  if ((endptr == str) || (*endptr != '\0')) {
     return tdm_result(1, "Invalid real value: %s", str);
   }
   *value = (real_t)v;
   return (tdm_result_t){0};
 }
 
+// Parses a boolean value from a string.
+static tdm_result_t parse_bool(const char *str, bool *value) {
+  if (!strcasecmp(str, "true") || !strcasecmp(str, "yes") ||
+      !strcasecmp(str, "on")) {
+    *value = true;
+  } else if (!strcasecmp(str, "false") || !strcasecmp(str, "no") ||
+             !strcasecmp(str, "off")) {
+    *value = false;
+  } else {
+    return tdm_result(1, "Invalid boolean value: %s", str);
+  }
+  return (tdm_result_t){0};
+}
+
 // Parses a parameter in the jigsaw block.
 static tdm_result_t parse_jigsaw_param(parser_state_t *state,
                                        const char     *param,
@@ -214,19 +238,14 @@ static tdm_result_t parse_extrusion_param(parser_state_t *state,
   return result;
 }
 
-// Parses a parameter in the output block.
+// Parses a parameter in the surface_mesh or column_mesh block within the
+// output block.
 static tdm_result_t parse_output_param(parser_state_t *state,
                                        const char     *param,
                                        tdm_config_t   *config) {
   tdm_result_t result = {};
 
-  if (!state->parsing_surface_mesh_output &&
-      !strcmp(state->current_param, "surface_mesh")) {
-    state->parsing_surface_mesh_output = true;
-  } else if (!state->parsing_column_mesh_output &&
-             !strcmp(state->current_param, "column_mesh")) {
-    state->parsing_column_mesh_output = true;
-  } else if (state->parsing_surface_mesh_output) {
+  if (state->parsing_surface_mesh_output) {
     if (!strcmp(state->current_param, "format")) {
       if (!strcmp(param, "exodus")) {
         config->surface_mesh_format = TDM_EXODUS;
@@ -249,8 +268,54 @@ static tdm_result_t parse_output_param(parser_state_t *state,
       }
     } else if (!strcmp(state->current_param, "filename")) {
       config->column_mesh_file = strdup(param);
+    } else if (!strcmp(state->current_param, "fv_geometry")) {
+      result = parse_bool(param, &(config->column_mesh_fv_geometry));
+    }
+  } else {
+    result = tdm_result(1, "Expected settings for %s in output block, got '%s'",
+                        state->current_param, param);
+  }
+  state->current_param[0] = 0;
+  return result;
+}
+
+// Parses a parameter in the partitioning block.
+static tdm_result_t parse_partitioning_param(parser_state_t *state,
+                                             const char     *param,
+                                             tdm_config_t   *config) {
+  tdm_result_t result = {};
+  if (!strcmp(state->current_param, "ranks")) {
+    result = parse_int32(param, &(config->num_ranks));
+    if (!result.err_code && (config->num_ranks <= 0)) {
+      result = tdm_result(1, "Invalid number of ranks: %s", param);
+    }
+  } else if (!strcmp(state->current_param, "column_costs")) {
+    config->column_cost_file = strdup(param);
+  } else if (!strcmp(state->current_param, "compare")) {
+    result = parse_bool(param, &(config->compare_partitions));
+  }
+  state->current_param[0] = 0;
+  return result;
+}
+
+// Parses a parameter in the decimation block.
+static tdm_result_t parse_decimation_param(parser_state_t *state,
+                                           const char     *param,
+                                           tdm_config_t   *config) {
+  tdm_result_t result = {};
+  if (!strcmp(state->current_param, "max_error")) {
+    result = parse_real(param, &(config->decimation_max_error));
+    if (!result.err_code && (config->decimation_max_error <= 0.0)) {
+      result = tdm_result(1, "Invalid decimation max_error: %s", param);
+    }
+  } else if (!strcmp(state->current_param, "min_angle")) {
+    result = parse_real(param, &(config->decimation_min_angle));
+    if (!result.err_code && ((config->decimation_min_angle < 0.0) ||
+                             (config->decimation_min_angle >= 60.0))) {
+      result = tdm_result(1, "Invalid decimation min_angle: %s", param);
     }
   }
+  state->current_param[0] = 0;
   return result;
 }
 
@@ -267,7 +332,7 @@ static tdm_result_t handle_yaml_event(yaml_event_t   *event,
       state->parsing_data = true;
     } else if (state->parsing_data) {
       if (!state->current_param[0]) { // check the parameter name
-        const char *valid_names[] = {"dem", "lat", "lon", "mask"};
+        const char *valid_names[] = {"dem", "lat", "lon", "mask", NULL};
         result = check_param_name("data", state->data_param_names,
                                   valid_names, value);
         strncpy(state->current_param, value, 128);
@@ -278,7 +343,15 @@ static tdm_result_t handle_yaml_event(yaml_event_t   *event,
       state->parsing_jigsaw = true;
     } else if (state->parsing_jigsaw) {
       if (!state->current_param[0]) { // check the parameter name
-        const char *valid_names[] = {"verbosity", "geom_seed", "geom_feat"}; // FIXME
+        const char *valid_names[] = {
+          "verbosity", "geom_seed", "geom_feat", "geom_eta1", "geom_eta2",
+          "init_near", "hfun_scal", "hfun_hmax", "hfun_hmin", "bnds_kern",
+          "mesh_dims", "mesh_kern", "mesh_iter", "mesh_top1", "mesh_top2",
+          "mesh_rad2", "mesh_rad3", "mesh_siz1", "mesh_siz2", "mesh_siz3",
+          "mesh_off2", "mesh_off3", "mesh_snk2", "mesh_snk3", "mesh_eps1",
+          "mesh_eps2", "mesh_vol3", "optm_kern", "optm_iter", "optm_qtol",
+          "optm_qlim", "optm_tria", "optm_dual", "optm_zip", "optm_div", NULL
+        };
         result = check_param_name("jigsaw", state->jigsaw_param_names,
                                   valid_names, value);
         strncpy(state->current_param, value, 128);
@@ -289,7 +362,8 @@ static tdm_result_t handle_yaml_event(yaml_event_t   *event,
       state->parsing_extrusion = true;
     } else if (state->parsing_extrusion) {
       if (!state->current_param[0]) { // check the parameter name
-        const char *valid_names[] = {"layers", "thickness", "thicknesses"};
+        const char *valid_names[] = {"layers", "thickness", "thicknesses",
+                                     NULL};
         result = check_param_name("extrusion", state->extrusion_param_names,
                                   valid_names, value);
         strncpy(state->current_param, value, 128);
@@ -300,24 +374,81 @@ static tdm_result_t handle_yaml_event(yaml_event_t   *event,
       state->parsing_output = true;
     } else if (state->parsing_output) {
       if (!state->current_param[0]) { // check the parameter name
-        const char *valid_names[] = {"surface_mesh", "column_mesh"};
-        result = check_param_name("output", state->output_param_names,
-                                  valid_names, value);
+        if (state->parsing_surface_mesh_output) {
+          const char *valid_names[] = {"format", "filename", NULL};
+          result = check_param_name("surface_mesh",
+                                    state->surface_mesh_param_names,
+                                    valid_names, value);
+        } else if (state->parsing_column_mesh_output) {
+          const char *valid_names[] = {"format", "filename", "fv_geometry",
+                                       NULL};
+          result = check_param_name("column_mesh",
+                                    state->column_mesh_param_names,
+                                    valid_names, value);
+        } else {
+          const char *valid_names[] = {"surface_mesh", "column_mesh", NULL};
+          result = check_param_name("output", state->output_param_names,
+                                    valid_names, value);
+        }
         strncpy(state->current_param, value, 128);
       } else { // parse the value
         result = parse_output_param(state, value, config);
       }
+    } else if (!state->parsing_partitioning && !strcmp(value, "partitioning")) {
+      state->parsing_partitioning = true;
+    } else if (state->parsing_partitioning) {
+      if (!state->current_param[0]) { // check the parameter name
+        const char *valid_names[] = {"ranks", "column_costs", "compare", NULL};
+        result = check_param_name("partitioning",
+                                  state->partitioning_param_names,
+                                  valid_names, value);
+        strncpy(state->current_param, value, 128);
+      } else { // parse the value
+        result = parse_partitioning_param(state, value, config);
+      }
+    } else if (!state->parsing_decimation && !strcmp(value, "decimation")) {
+      state->parsing_decimation = true;
+    } else if (state->parsing_decimation) {
+      if (!state->current_param[0]) { // check the parameter name
+        const char *valid_names[] = {"max_error", "min_angle", NULL};
+        result = check_param_name("decimation",
+                                  state->decimation_param_names,
+                                  valid_names, value);
+        strncpy(state->current_param, value, 128);
+      } else { // parse the value
+        result = parse_decimation_param(state, value, config);
+      }
     }
   } else if (event->type == YAML_MAPPING_START_EVENT) {
-    if (state->current_param[0]) { // we're already parsing a parameter
+    // The output block contains a block for each mesh.
+    if (state->parsing_output && !state->parsing_surface_mesh_output &&
+        !state->parsing_column_mesh_output &&
+        !strcmp(state->current_param, "surface_mesh")) {
+      state->parsing_surface_mesh_output = true;
+      state->current_param[0] = 0;
+    } else if (state->parsing_output && !state->parsing_surface_mesh_output &&
+               !state->parsing_column_mesh_output &&
+               !strcmp(state->current_param, "column_mesh")) {
+      state->parsing_column_mesh_output = true;
+      state->current_param[0] = 0;
+    } else if (state->current_param[0]) { // we're already parsing a parameter
       return tdm_result(1, "Illegal mapping encountered in parameter %s",
         state->current_param);
     }
   } else if (event->type == YAML_MAPPING_END_EVENT) {
+    if (state->parsing_surface_mesh_output ||
+        state->parsing_column_mesh_output) { // back to the output block
+      state->parsing_surface_mesh_output = false;
+      state->parsing_column_mesh_output = false;
+      state->current_param[0] = 0;
+      return result;
+    }
     state->parsing_data = false;
     state->parsing_jigsaw = false;
     state->parsing_extrusion = false;
     state->parsing_output = false;
+    state->parsing_partitioning = false;
+    state->parsing_decimation = false;
     state->current_param[0] = 0;
   } else if (event->type == YAML_SEQUENCE_START_EVENT) {
     if (state->parsing_extrusion && !state->parsing_thicknesses) {
@@ -328,6 +459,12 @@ static tdm_result_t handle_yaml_event(yaml_event_t   *event,
       return tdm_result(1, "Encountered illegal array value in jigsaw block.");
     } else if (state->parsing_output) {
       return tdm_result(1, "Encountered illegal array value in output block.");
+    } else if (state->parsing_partitioning) {
+      return tdm_result(1,
+        "Encountered illegal array value in partitioning block.");
+    } else if (state->parsing_decimation) {
+      return tdm_result(1,
+        "Encountered illegal array value in decimation block.");
     }
   } else if (event->type == YAML_SEQUENCE_END_EVENT) {
     if (state->parsing_extrusion && state->parsing_thicknesses) {
@@ -352,6 +489,10 @@ static void destroy_state(parser_state_t state) {
   destroy_name_set(state.jigsaw_param_names);
   destroy_name_set(state.extrusion_param_names);
   destroy_name_set(state.output_param_names);
+  destroy_name_set(state.surface_mesh_param_names);
+  destroy_name_set(state.column_mesh_param_names);
+  destroy_name_set(state.partitioning_param_names);
+  destroy_name_set(state.decimation_param_names);
 }
 
 tdm_result_t read_yaml(const char *yaml_file, tdm_config_t *config) {
@@ -365,11 +506,18 @@ tdm_result_t read_yaml(const char *yaml_file, tdm_config_t *config) {
   yaml_parser_initialize(&parser);
   yaml_parser_set_input_file(&parser, file);
 
+  // Start from jigsaw's defaults for any settings not given.
+  jigsaw_init_jig_t(&config->jigsaw);
+
   parser_state_t state = {
     .data_param_names      = kh_init(yaml_name_set),
     .jigsaw_param_names    = kh_init(yaml_name_set),
     .extrusion_param_names = kh_init(yaml_name_set),
-    .output_param_names    = kh_init(yaml_name_set)
+    .output_param_names    = kh_init(yaml_name_set),
+    .surface_mesh_param_names = kh_init(yaml_name_set),
+    .column_mesh_param_names  = kh_init(yaml_name_set),
+    .partitioning_param_names = kh_init(yaml_name_set),
+    .decimation_param_names   = kh_init(yaml_name_set)
   };
   yaml_event_type_t event_type;
   do {
@@ -0,0 +1,314 @@
+#include "stream.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <zlib.h>
+#ifdef TDM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Formats recognized by their leading ("magic") bytes.
+typedef enum {
+  TDM_STREAM_PLAIN,
+  TDM_STREAM_GZIP,
+  TDM_STREAM_ZSTD
+} tdm_stream_format_t;
+
+// A buffer in a stream's ring.
+typedef struct stream_buffer_t {
+  char   data[TDM_STREAM_BUFFER_SIZE];
+  size_t size;
+} stream_buffer_t;
+
+struct tdm_stream_t {
+  const char         *file_name;
+  FILE               *file;
+  tdm_stream_format_t format;
+
+  // compressed input staging area and decoder state
+  unsigned char *input;
+  bool           frame_ended; // true if the decoder finished its last frame
+  z_stream       gzip;
+#ifdef TDM_HAVE_ZSTD
+  ZSTD_DCtx     *zstd;
+  ZSTD_inBuffer  zstd_input;
+#endif
+
+  // ring of buffers, filled at head by the reader thread and consumed at tail
+  stream_buffer_t buffers[TDM_STREAM_NUM_BUFFERS];
+  int             head, tail, num_full;
+  bool            holding_tail; // true if the consumer holds the tail buffer
+
+  // reader thread and synchronization
+  pthread_t       thread;
+  bool            started;
+  pthread_mutex_t mutex;
+  pthread_cond_t  not_full, not_empty;
+  bool            done, canceled;
+  tdm_result_t    result; // result of the reader thread
+};
+
+// Determines the format of the given file from its first few bytes, rewinding
+// it afterward.
+static tdm_stream_format_t detect_format(FILE *file) {
+  unsigned char magic[4] = {0};
+  size_t n = fread(magic, 1, 4, file);
+  rewind(file);
+  if ((n >= 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b)) {
+    return TDM_STREAM_GZIP;
+  } else if ((n == 4) && (magic[0] == 0x28) && (magic[1] == 0xb5) &&
+             (magic[2] == 0x2f) && (magic[3] == 0xfd)) {
+    return TDM_STREAM_ZSTD;
+  }
+  return TDM_STREAM_PLAIN;
+}
+
+// Fills the given buffer with uncompressed data.
+static tdm_result_t read_plain(tdm_stream_t *stream, stream_buffer_t *buffer) {
+  buffer->size = fread(buffer->data, 1, TDM_STREAM_BUFFER_SIZE, stream->file);
+  if ((buffer->size < TDM_STREAM_BUFFER_SIZE) && ferror(stream->file)) {
+    return tdm_result(1, "Error reading '%s'.", stream->file_name);
+  }
+  return (tdm_result_t){0};
+}
+
+// Fills the given buffer with data decompressed from a gzip file. Files with
+// several concatenated gzip members are handled.
+static tdm_result_t read_gzip(tdm_stream_t *stream, stream_buffer_t *buffer) {
+  z_stream *z = &stream->gzip;
+  z->next_out  = (unsigned char*)buffer->data;
+  z->avail_out = TDM_STREAM_BUFFER_SIZE;
+  while (z->avail_out > 0) {
+    bool at_eof = false;
+    if (z->avail_in == 0) {
+      size_t n = fread(stream->input, 1, TDM_STREAM_BUFFER_SIZE, stream->file);
+      if (n == 0) {
+        if (ferror(stream->file)) {
+          return tdm_result(1, "Error reading '%s'.", stream->file_name);
+        } else if (stream->frame_ended) {
+          break;
+        }
+        // The decoder may still hold output that didn't fit in the last
+        // buffer, so we let it run without input before calling this file
+        // truncated.
+        at_eof = true;
+      } else {
+        z->next_in  = stream->input;
+        z->avail_in = (unsigned int)n;
+      }
+    }
+    unsigned int avail_out = z->avail_out;
+    int ret = inflate(z, Z_NO_FLUSH);
+    if (at_eof && (ret != Z_STREAM_END) && (z->avail_out == avail_out)) {
+      return tdm_result(1, "Compressed file '%s' is truncated!",
+                        stream->file_name);
+    }
+    if (ret == Z_STREAM_END) {
+      inflateReset(z);
+      stream->frame_ended = true;
+    } else if ((ret == Z_OK) || (ret == Z_BUF_ERROR)) {
+      stream->frame_ended = false;
+    } else {
+      return tdm_result(1, "Error decompressing '%s': %s", stream->file_name,
+                        z->msg ? z->msg : "invalid gzip data");
+    }
+  }
+  buffer->size = TDM_STREAM_BUFFER_SIZE - z->avail_out;
+  return (tdm_result_t){0};
+}
+
+// Fills the given buffer with data decompressed from a zstd file.
+static tdm_result_t read_zstd(tdm_stream_t *stream, stream_buffer_t *buffer) {
+#ifdef TDM_HAVE_ZSTD
+  ZSTD_inBuffer *in = &stream->zstd_input;
+  ZSTD_outBuffer out = {.dst = buffer->data, .size = TDM_STREAM_BUFFER_SIZE};
+  while (out.pos < out.size) {
+    bool at_eof = false;
+    if (in->pos == in->size) {
+      size_t n = fread(stream->input, 1, TDM_STREAM_BUFFER_SIZE, stream->file);
+      if (n == 0) {
+        if (ferror(stream->file)) {
+          return tdm_result(1, "Error reading '%s'.", stream->file_name);
+        } else if (stream->frame_ended) {
+          break;
+        }
+        // The decoder can consume all its input while holding decoded data
+        // that didn't fit in the last buffer, so we let it run without input
+        // before calling this file truncated.
+        *in = (ZSTD_inBuffer){.src = stream->input, .size = 0};
+        at_eof = true;
+      } else {
+        *in = (ZSTD_inBuffer){.src = stream->input, .size = n};
+      }
+    }
+    size_t pos = out.pos;
+    size_t ret = ZSTD_decompressStream(stream->zstd, &out, in);
+    if (ZSTD_isError(ret)) {
+      return tdm_result(1, "Error decompressing '%s': %s", stream->file_name,
+                        ZSTD_getErrorName(ret));
+    }
+    stream->frame_ended = (ret == 0);
+    if (at_eof && !stream->frame_ended && (out.pos == pos)) {
+      return tdm_result(1, "Compressed file '%s' is truncated!",
+                        stream->file_name);
+    }
+  }
+  buffer->size = out.pos;
+  return (tdm_result_t){0};
+#else
+  return tdm_result(1, "Can't read '%s': tdm was built without zstd support.",
+                    stream->file_name);
+#endif
+}
+
+// This function runs in the stream's reader thread, filling buffers until the
+// file is exhausted, an error occurs, or the stream is closed.
+static void *read_stream(void *context) {
+  tdm_stream_t *stream = context;
+  tdm_result_t result = {};
+  while (true) {
+    // Wait for an empty buffer.
+    pthread_mutex_lock(&stream->mutex);
+    while ((stream->num_full == TDM_STREAM_NUM_BUFFERS) && !stream->canceled) {
+      pthread_cond_wait(&stream->not_full, &stream->mutex);
+    }
+    bool canceled = stream->canceled;
+    stream_buffer_t *buffer = &stream->buffers[stream->head];
+    pthread_mutex_unlock(&stream->mutex);
+    if (canceled) break;
+
+    // Fill it without holding the lock--the consumer doesn't touch it.
+    if (stream->format == TDM_STREAM_GZIP) {
+      result = read_gzip(stream, buffer);
+    } else if (stream->format == TDM_STREAM_ZSTD) {
+      result = read_zstd(stream, buffer);
+    } else {
+      result = read_plain(stream, buffer);
+    }
+    if (result.err_code || (buffer->size == 0)) break;
+
+    // Hand it off.
+    pthread_mutex_lock(&stream->mutex);
+    stream->head = (stream->head + 1) % TDM_STREAM_NUM_BUFFERS;
+    ++stream->num_full;
+    pthread_cond_signal(&stream->not_empty);
+    pthread_mutex_unlock(&stream->mutex);
+  }
+
+  pthread_mutex_lock(&stream->mutex);
+  stream->result = result;
+  stream->done = true;
+  pthread_cond_signal(&stream->not_empty);
+  pthread_mutex_unlock(&stream->mutex);
+  return NULL;
+}
+
+tdm_result_t tdm_stream_open(const char *file, tdm_stream_t **stream) {
+  *stream = NULL;
+  FILE *f = fopen(file, "rb");
+  if (!f) {
+    return tdm_result(1, "Could not open file '%s'.", file);
+  }
+
+  tdm_stream_t *s = calloc(1, sizeof(tdm_stream_t));
+  s->file_name = file;
+  s->file = f;
+  s->format = detect_format(f);
+  s->frame_ended = true;
+  if (s->format != TDM_STREAM_PLAIN) {
+    s->input = malloc(TDM_STREAM_BUFFER_SIZE);
+  }
+  if (s->format == TDM_STREAM_GZIP) {
+    // 15 + 32 -> maximum window size with gzip/zlib header detection
+    if (inflateInit2(&s->gzip, 15 + 32) != Z_OK) {
+      free(s->input);
+      free(s);
+      fclose(f);
+      return tdm_result(1, "Could not initialize gzip decompression for '%s'.",
+                        file);
+    }
+  }
+#ifdef TDM_HAVE_ZSTD
+  if (s->format == TDM_STREAM_ZSTD) {
+    s->zstd = ZSTD_createDCtx();
+    if (!s->zstd) {
+      free(s->input);
+      free(s);
+      fclose(f);
+      return tdm_result(1, "Could not initialize zstd decompression for '%s'.",
+                        file);
+    }
+  }
+#endif
+
+  pthread_mutex_init(&s->mutex, NULL);
+  pthread_cond_init(&s->not_full, NULL);
+  pthread_cond_init(&s->not_empty, NULL);
+  if (pthread_create(&s->thread, NULL, read_stream, s)) {
+    tdm_stream_close(s);
+    return tdm_result(1, "Could not start reader thread for '%s'.", file);
+  }
+  s->started = true;
+  *stream = s;
+  return (tdm_result_t){0};
+}
+
+tdm_result_t tdm_stream_next(tdm_stream_t *stream,
+                             const char  **chunk,
+                             size_t       *chunk_size) {
+  tdm_result_t result = {};
+  *chunk = NULL;
+  *chunk_size = 0;
+
+  pthread_mutex_lock(&stream->mutex);
+
+  // Release the buffer we handed out last time.
+  if (stream->holding_tail) {
+    stream->tail = (stream->tail + 1) % TDM_STREAM_NUM_BUFFERS;
+    --stream->num_full;
+    stream->holding_tail = false;
+    pthread_cond_signal(&stream->not_full);
+  }
+
+  // Wait for the next one.
+  while ((stream->num_full == 0) && !stream->done) {
+    pthread_cond_wait(&stream->not_empty, &stream->mutex);
+  }
+  if (stream->num_full > 0) {
+    stream_buffer_t *buffer = &stream->buffers[stream->tail];
+    *chunk = buffer->data;
+    *chunk_size = buffer->size;
+    stream->holding_tail = true;
+  } else { // the reader thread has finished
+    result = stream->result;
+  }
+
+  pthread_mutex_unlock(&stream->mutex);
+  return result;
+}
+
+void tdm_stream_close(tdm_stream_t *stream) {
+  // Stop the reader thread if it's still going.
+  if (stream->started) {
+    pthread_mutex_lock(&stream->mutex);
+    stream->canceled = true;
+    pthread_cond_signal(&stream->not_full);
+    pthread_mutex_unlock(&stream->mutex);
+    pthread_join(stream->thread, NULL);
+  }
+
+  if (stream->format == TDM_STREAM_GZIP) {
+    inflateEnd(&stream->gzip);
+  }
+#ifdef TDM_HAVE_ZSTD
+  if (stream->zstd) {
+    ZSTD_freeDCtx(stream->zstd);
+  }
+#endif
+  pthread_cond_destroy(&stream->not_empty);
+  pthread_cond_destroy(&stream->not_full);
+  pthread_mutex_destroy(&stream->mutex);
+  if (stream->input) free(stream->input);
+  fclose(stream->file);
+  free(stream);
+}
@@ -0,0 +1,35 @@
+#ifndef TDM_STREAM_H
+#define TDM_STREAM_H
+
+#include "tdm.h"
+
+// A tdm_stream_t reads the contents of a file in a background thread, handing
+// them off in chunks through a ring of buffers. Files compressed with gzip (or
+// zstd, if enabled) are detected automatically and decompressed on the fly, so
+// their contents never touch the disk.
+typedef struct tdm_stream_t tdm_stream_t;
+
+// The number of buffers in a stream's ring, and the size of each buffer. The
+// reader thread can get this many buffers ahead of the consumer.
+#define TDM_STREAM_NUM_BUFFERS 4
+#define TDM_STREAM_BUFFER_SIZE (1 << 20)
+
+// The memory used by an open stream: its ring, plus a staging area for
+// compressed input.
+#define TDM_STREAM_MEMORY \
+  ((size_t)(TDM_STREAM_NUM_BUFFERS + 1) * TDM_STREAM_BUFFER_SIZE)
+
+// Opens the given file for streaming and starts reading it in the background.
+tdm_result_t tdm_stream_open(const char *file, tdm_stream_t **stream);
+
+// Fetches the next chunk of data from the given stream, blocking until it's
+// available. The chunk remains valid until the next call to tdm_stream_next
+// or tdm_stream_close. A chunk size of zero indicates the end of the stream.
+tdm_result_t tdm_stream_next(tdm_stream_t *stream,
+                             const char  **chunk,
+                             size_t       *chunk_size);
+
+// Stops reading the given stream (if needed) and frees its resources.
+void tdm_stream_close(tdm_stream_t *stream);
+
+#endif
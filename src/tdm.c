@@ -1,8 +1,13 @@
 #include "tdm.h"
+#include "point_grid.h"
+#include "stream.h"
 
 #include <ctype.h>
 #include <float.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <unistd.h>
 
 // This function returns a newly created result with the given error code and
 // formatted message.
@@ -15,84 +20,195 @@ tdm_result_t tdm_result(int err_code, const char *fmt, ...) {
   return result;
 }
 
-// Reads real-valued data from a text file into an array.
-static tdm_result_t read_point_data(const char  *text_file,
-                                    real_t     **data,
-                                    size_t      *size) {
-  tdm_result_t result = {};
-  char *buffer = NULL;
-  *data = NULL;
-  *size = 0;
+// The longest token (number) we accept in a text data file.
+#define TDM_MAX_TOKEN_LEN 128
 
-  FILE *f = fopen(text_file, "r");
-  if (!f) {
-    result = tdm_result(1, "Could not open text file '%s'.", text_file);
-    goto finished;
-  }
+// This callback type is used to visit each whitespace-delimited token in a
+// text file. The token is not NUL-terminated, and offset gives the location of
+// its first byte in the (uncompressed) file. A newline is reported as a token of
+// zero length.
+typedef tdm_result_t (*token_visitor_t)(const char *token,
+                                        size_t      length,
+                                        size_t      offset,
+                                        void       *context);
 
-  // Read the file's contents into memory.
-  fseek(f, 0, SEEK_END);
-  size_t file_size = (size_t)ftell(f);
-  rewind(f);
-  buffer = malloc(sizeof(char) * file_size);
-  fread(buffer, sizeof(char), file_size, f);
+// Streams the given text file (decompressing it if needed), calling visit on
+// each token. The file is read in a background thread, so parsing overlaps
+// with reading and decompression.
+static tdm_result_t visit_tokens(const char     *text_file,
+                                 token_visitor_t visit,
+                                 void           *context) {
+  tdm_stream_t *stream;
+  tdm_result_t result = tdm_stream_open(text_file, &stream);
+  if (result.err_code) return result;
 
-  // The file contains a bunch of numbers separated by whitespace. We read these
-  // numbers into an array, dynamically resizing it as needed.
+  // A token split across two chunks is assembled here.
+  char carry[TDM_MAX_TOKEN_LEN];
+  size_t carry_len = 0, carry_offset = 0;
 
-  // Line up the first number.
-  size_t offset = 0;
-  while (!isdigit(buffer[offset]) && offset < file_size) ++offset;
-  if (offset == file_size) {
-    result = tdm_result(1, "No numeric data found in '%s'!", text_file);
-    goto finished;
-  }
+  size_t chunk_offset = 0;
+  const char *chunk;
+  size_t chunk_size;
+  while (true) {
+    result = tdm_stream_next(stream, &chunk, &chunk_size);
+    if (result.err_code || (chunk_size == 0)) break;
+
+    const char *p = chunk, *end = chunk + chunk_size;
+    while (p < end) {
+      // Finish any token carried over from the last chunk. It's too long only
+      // if another character would be appended to it.
+      if (carry_len) {
+        while ((p < end) && !isspace(*p)) {
+          if (carry_len == TDM_MAX_TOKEN_LEN) {
+            result = tdm_result(1, "Invalid numeric data found at byte %zd of "
+                                "'%s'!", carry_offset, text_file);
+            goto finished;
+          }
+          carry[carry_len++] = *p++;
+        }
+        if (p == end) break;
+        result = visit(carry, carry_len, carry_offset, context);
+        if (result.err_code) goto finished;
+        carry_len = 0;
+      }
 
-  // Allocate (preliminary) storage.
-  size_t n = 0, cap = 1024;
-  real_t *array = malloc(sizeof(real_t) * cap);
-
-  // Read numbers till the end.
-  while (offset < file_size) {
-    char *endptr;
-    real_t datum = strtod(&buffer[offset], &endptr);
-    if (endptr) {
-      if (!isspace(endptr[0])) { // whitespace is fine--go to next number
-        array[n] = datum;
-        ++n;
-        if (n >= cap) { // resize if needed
-          while (cap <= n) cap *= 2;
-          array = realloc(array, sizeof(real_t) * cap);
+      // Skip whitespace, reporting newlines.
+      while ((p < end) && isspace(*p)) {
+        if (*p == '\n') {
+          result = visit(p, 0, chunk_offset + (p - chunk), context);
+          if (result.err_code) goto finished;
         }
-        offset += (endptr - &buffer[offset]);
-        while (isspace(buffer[offset])) ++offset;
+        ++p;
+      }
+
+      // Find the end of the next token. If it runs off the end of the chunk,
+      // carry it over.
+      const char *start = p;
+      while ((p < end) && !isspace(*p)) ++p;
+      if (p == start) continue;
+      size_t offset = chunk_offset + (start - chunk);
+      if (p == end) {
+        if (p - start > TDM_MAX_TOKEN_LEN) {
+          result = tdm_result(1, "Invalid numeric data found at byte %zd of '%s'!",
+                              offset, text_file);
+          goto finished;
+        }
+        memcpy(carry, start, p - start);
+        carry_len = p - start;
+        carry_offset = offset;
       } else {
-        result = tdm_result(1, "Invalid numeric data found at byte %zd of '%s'!",
-                            offset, text_file);
-        free(array);
-        goto finished;
+        result = visit(start, p - start, offset, context);
+        if (result.err_code) goto finished;
       }
     }
+    chunk_offset += chunk_size;
+  }
+
+  // Handle a token that ends the file.
+  if (!result.err_code && carry_len) {
+    result = visit(carry, carry_len, carry_offset, context);
   }
 
-  // Hand off the data.
-  *data = array;
-  *size = n;
 finished:
-  if (buffer) free(buffer);
-  if (f) fclose(f);
+  tdm_stream_close(stream);
+  return result;
+}
+
+// Parses a real number from the given token, returning true on success.
+static bool parse_token(const char *token, size_t length, real_t *value) {
+  if (length > TDM_MAX_TOKEN_LEN) return false;
+  char buffer[TDM_MAX_TOKEN_LEN+1];
+  memcpy(buffer, token, length);
+  buffer[length] = 0;
+  char *endptr;
+  *value = strtod(buffer, &endptr);
+  return (endptr == buffer + length);
+}
+
+// This type accumulates numbers read by read_point_data.
+typedef struct point_data_t {
+  const char *text_file;
+  real_t     *array;
+  size_t      size, capacity;
+} point_data_t;
+
+// Appends a number to an array of point data.
+static tdm_result_t append_point_datum(const char *token,
+                                       size_t      length,
+                                       size_t      offset,
+                                       void       *context) {
+  point_data_t *data = context;
+  if (length == 0) return (tdm_result_t){0}; // newlines don't matter here
+
+  real_t datum;
+  if (!parse_token(token, length, &datum)) {
+    // Skip anything (e.g. a header) that precedes the first number.
+    if (data->size == 0) return (tdm_result_t){0};
+    return tdm_result(1, "Invalid numeric data found at byte %zd of '%s'!",
+                      offset, data->text_file);
+  }
+
+  if (data->size == data->capacity) { // resize if needed
+    data->capacity = data->capacity ? 2 * data->capacity : 1024;
+    data->array = realloc(data->array, sizeof(real_t) * data->capacity);
+  }
+  data->array[data->size] = datum;
+  ++data->size;
+  return (tdm_result_t){0};
+}
+
+// Reads real-valued data from a text file into an array. The file may be
+// compressed with gzip or zstd, in which case it's decompressed in memory while
+// its contents are parsed.
+static tdm_result_t read_point_data(const char  *text_file,
+                                    real_t     **data,
+                                    size_t      *size) {
+  *data = NULL;
+  *size = 0;
+
+  // The file contains a bunch of numbers separated by whitespace. We read these
+  // numbers into an array, dynamically resizing it as needed.
+  point_data_t point_data = {.text_file = text_file};
+  tdm_result_t result = visit_tokens(text_file, append_point_datum, &point_data);
+  if (!result.err_code && (point_data.size == 0)) {
+    result = tdm_result(1, "No numeric data found in '%s'!", text_file);
+  }
+
+  // Hand off the data.
+  if (result.err_code) {
+    free(point_data.array);
+  } else {
+    *data = point_data.array;
+    *size = point_data.size;
+  }
   return result;
 }
 
+// Computes differential coordinate spacings dx_dlat (easterly distance between
+// longitudes per degree latitude) and dy_dlon (northerly distance between
+// latitudes) at the given latitude (in degrees) using the WGS84 spheroid
+// approximation
+// (https://en.wikipedia.org/wiki/Geographic_coordinate_system#Length_of_a_degree).
+static void compute_neu_spacings(real_t  lat_degrees,
+                                 real_t *dx_dlon,
+                                 real_t *dy_dlat) {
+  real_t lat = lat_degrees * PETSC_PI / 180.0;
+  *dx_dlon = 111412.84 * cos(lat) - 93.5 * cos(3*lat) + 0.118 * cos(5*lat);
+  *dy_dlat = 111132.92 - 559.82 * cos(2.0*lat) + 1.175 * cos(4*lat) -
+             0.0023 * cos(6*lat);
+}
+
 tdm_result_t extract_points(tdm_config_t config,
                             size_t      *num_points,
                             point_t    **points) {
   tdm_result_t result = {};
+  *num_points = 0;
+  *points = NULL;
 
   // Read point elevation, latitude, longitude data and transform it to 3D
   // cartesian coordinates on a plane.
   real_t *elev_data = NULL, *lat_data = NULL, *lon_data = NULL,
-         *mask_data = NULL;
+         *mask_data = NULL, *cost_data = NULL;
   size_t n, n1;
   result = read_point_data(config.dem_file, &elev_data, &n);
   if (result.err_code) goto finished;
@@ -121,6 +237,16 @@ tdm_result_t extract_points(tdm_config_t config,
   }
   if (result.err_code) goto finished;
 
+  if (config.column_cost_file) {
+    result = read_point_data(config.column_cost_file, &cost_data, &n1);
+    if (!result.err_code && (n1 != n)) {
+      result = tdm_result(1,
+        "Number of column costs (%zd) != number of elevations (%zd).",
+        n1, n);
+    }
+    if (result.err_code) goto finished;
+  }
+
   // Transform the point data to cartesian coordinates above the x-y plane.
   // Here, we use x to indicate displacements between longitudes, and y for
   // displacements between latitudes.
@@ -132,8 +258,8 @@ tdm_result_t extract_points(tdm_config_t config,
   for (size_t i = 0; i < n; ++i) {
     if (min_lat > lat_data[i]) min_lat = lat_data[i];
     if (max_lat < lat_data[i]) max_lat = lat_data[i];
-    if (min_lon > lat_data[i]) min_lon = lat_data[i];
-    if (max_lon < lat_data[i]) max_lon = lat_data[i];
+    if (min_lon > lon_data[i]) min_lon = lon_data[i];
+    if (max_lon < lon_data[i]) max_lon = lon_data[i];
   }
 
   // Now we assume that the data covers a portion of the earth that is small
@@ -145,14 +271,9 @@ tdm_result_t extract_points(tdm_config_t config,
   real_t med_lat = 0.5 * (min_lat + max_lat);
   real_t med_lon = 0.5 * (min_lon + max_lon);
 
-  // Compute differential coordinate spacings dx_dlat (easterly distance between
-  // longitudes per degree latitude) and dy_dlon (northerly distance between
-  // latitudes) at this point using the WGS84 spheroid approximation
-  // (https://en.wikipedia.org/wiki/Geographic_coordinate_system#Length_of_a_degree).
-  real_t dx_dlon = 111412.84 * cos(med_lat) - 93.5 * cos(3*med_lat) +
-                   0.118 * cos(5*med_lat);
-  real_t dy_dlat = 111132.92 - 559.82 * cos(2.0*med_lat) +
-                   1.175 * cos(4*med_lat) - 0.0023 * cos(6*med_lat);
+  // Compute differential coordinate spacings at this point.
+  real_t dx_dlon, dy_dlat;
+  compute_neu_spacings(med_lat, &dx_dlon, &dy_dlat);
 
   *num_points = n;
   *points = malloc(sizeof(point_t) * n);
@@ -166,7 +287,9 @@ tdm_result_t extract_points(tdm_config_t config,
     point_t p = {
       .x = dx_dlon * dlon,
       .y = dy_dlat * dlat,
-      .z = elev_data[i]
+      .z = elev_data[i],
+      .mask = (mask_data[i] != 0.0),
+      .cost = (cost_data) ? cost_data[i] : 1.0
     };
     (*points)[i] = p;
   }
@@ -176,6 +299,7 @@ finished:
   if (lat_data) free(lat_data);
   if (lon_data) free(lon_data);
   if (mask_data) free(mask_data);
+  if (cost_data) free(cost_data);
   if (result.err_code) {
     *num_points = 0;
     free(*points);
@@ -184,6 +308,288 @@ finished:
   return result;
 }
 
+// Per-stage cost model coefficients used by estimate_resources. These are
+// rough figures and should be recalibrated against benchmark runs whenever the
+// underlying stages change significantly.
+#define TDM_SECONDS_PER_TEXT_VALUE  5.0e-8  // time to parse a number
+#define TDM_BYTES_PER_TRIANGLE      512     // jigsaw working set per triangle
+#define TDM_SECONDS_PER_TRIANGLE    4.0e-6  // jigsaw time per triangle
+#define TDM_BYTES_PER_PLEX_CELL     1536    // DMPlex storage per prism
+#define TDM_SECONDS_PER_PLEX_CELL   1.0e-6  // extrusion time per prism
+#define TDM_SECONDS_PER_OUTPUT_CELL 5.0e-7  // output time per prism
+#define TDM_PLEX_POINTS_PER_CELL    6       // cells, faces, edges, vertices
+
+// The numbers of reals and integers describing a single cell when finite-volume
+// geometry is migrated to a distributed mesh: volume, centroid, face areas and
+// face normals; serial cell index and neighbors.
+#define TDM_FV_CELL_NUM_REALS (4 + 4*TDM_PRISM_NUM_FACES)
+#define TDM_FV_CELL_NUM_INTS  (1 + TDM_PRISM_NUM_FACES)
+
+// Storage for the finite-volume geometry of a prism (tdm_fv_geometry_t), and
+// the migration buffers for a DMPlex point, which hold the geometry of a cell.
+#define TDM_FV_BYTES_PER_CELL \
+  (TDM_FV_CELL_NUM_REALS * sizeof(PetscReal) + \
+   TDM_PRISM_NUM_FACES * sizeof(PetscInt))
+#define TDM_FV_BYTES_PER_PACKED_POINT \
+  (TDM_FV_CELL_NUM_REALS * sizeof(PetscReal) + \
+   TDM_FV_CELL_NUM_INTS * sizeof(PetscInt))
+
+// Resource limits used to recommend a number of MPI ranks.
+#define TDM_MEMORY_PER_RANK   ((size_t)2 << 30) // 2 GiB
+#define TDM_MAX_CELLS_PER_RANK 1000000
+
+// This type tracks the dimensions of a raster scanned by scan_raster.
+typedef struct raster_scan_t {
+  const char *text_file;
+  size_t num_rows, num_cols, num_nonzero;
+  size_t row_length; // number of values in the current row
+} raster_scan_t;
+
+// Counts a raster value, or finishes a row at a newline, making sure all rows
+// have the same length.
+static tdm_result_t count_raster_value(const char *token,
+                                       size_t      length,
+                                       size_t      offset,
+                                       void       *context) {
+  raster_scan_t *scan = context;
+  if (length == 0) { // newline
+    if (scan->row_length == 0) return (tdm_result_t){0}; // skip blank lines
+    if (scan->num_cols == 0) {
+      scan->num_cols = scan->row_length;
+    } else if (scan->row_length != scan->num_cols) {
+      return tdm_result(1, "Row %zd of '%s' has %zd values (expected %zd).",
+                        scan->num_rows, scan->text_file, scan->row_length,
+                        scan->num_cols);
+    }
+    ++scan->num_rows;
+    scan->row_length = 0;
+  } else {
+    real_t datum;
+    if (!parse_token(token, length, &datum)) {
+      // Skip anything (e.g. a header) that precedes the first number, as
+      // read_point_data does.
+      if ((scan->num_rows == 0) && (scan->row_length == 0)) {
+        return (tdm_result_t){0};
+      }
+      return tdm_result(1, "Invalid numeric data found at byte %zd of '%s'!",
+                        offset, scan->text_file);
+    }
+    if (datum != 0.0) ++scan->num_nonzero;
+    ++scan->row_length;
+  }
+  return (tdm_result_t){0};
+}
+
+// Scans the given text file for the dimensions of the 2D array it contains and
+// the number of nonzero entries within it, without storing any of its data.
+static tdm_result_t scan_raster(const char *text_file,
+                                size_t     *num_rows,
+                                size_t     *num_cols,
+                                size_t     *num_nonzero) {
+  raster_scan_t scan = {.text_file = text_file};
+  tdm_result_t result = visit_tokens(text_file, count_raster_value, &scan);
+  if (!result.err_code && scan.row_length) { // no newline at end of file
+    result = count_raster_value(NULL, 0, 0, &scan);
+  }
+  if (!result.err_code && (scan.num_rows == 0)) {
+    result = tdm_result(1, "No numeric data found in '%s'!", text_file);
+  }
+  *num_rows = scan.num_rows;
+  *num_cols = scan.num_cols;
+  *num_nonzero = scan.num_nonzero;
+  return result;
+}
+
+// This type tracks the range of the values in a file scanned by scan_extent.
+typedef struct extent_scan_t {
+  const char *text_file;
+  size_t      num_values;
+  real_t      min, max;
+} extent_scan_t;
+
+// Includes a value in the range of a scanned file.
+static tdm_result_t update_extent(const char *token,
+                                  size_t      length,
+                                  size_t      offset,
+                                  void       *context) {
+  extent_scan_t *scan = context;
+  if (length == 0) return (tdm_result_t){0}; // newlines don't matter here
+
+  real_t datum;
+  if (!parse_token(token, length, &datum)) {
+    // Skip anything (e.g. a header) that precedes the first number.
+    if (scan->num_values == 0) return (tdm_result_t){0};
+    return tdm_result(1, "Invalid numeric data found at byte %zd of '%s'!",
+                      offset, scan->text_file);
+  }
+  if (scan->min > datum) scan->min = datum;
+  if (scan->max < datum) scan->max = datum;
+  ++scan->num_values;
+  return (tdm_result_t){0};
+}
+
+// Scans the given text file for the number of values it contains and their
+// minimum and maximum, without storing any of its data.
+static tdm_result_t scan_extent(const char *text_file,
+                                size_t     *num_values,
+                                real_t     *min,
+                                real_t     *max) {
+  extent_scan_t scan = {
+    .text_file = text_file, .min = FLT_MAX, .max = -FLT_MAX
+  };
+  tdm_result_t result = visit_tokens(text_file, update_extent, &scan);
+  if (!result.err_code && (scan.num_values == 0)) {
+    result = tdm_result(1, "No numeric data found in '%s'!", text_file);
+  }
+  *num_values = scan.num_values;
+  *min = scan.min;
+  *max = scan.max;
+  return result;
+}
+
+tdm_result_t estimate_resources(tdm_config_t    config,
+                                tdm_estimate_t *estimate) {
+  *estimate = (tdm_estimate_t){0};
+
+  // Scan the mask for the raster dimensions and the number of points that
+  // belong to the domain.
+  tdm_result_t result = scan_raster(config.mask_file, &estimate->num_rows,
+                                    &estimate->num_cols,
+                                    &estimate->num_masked_points);
+  if (result.err_code) return result;
+  size_t num_values = estimate->num_rows * estimate->num_cols;
+
+  // Estimate the area covered by the masked points and the target length of
+  // a triangle edge. With relative hfun settings, jigsaw scales hfun_hmax by
+  // the mean length of the geometry's bounding box, so we can work in units of
+  // raster cells. With absolute settings, we need the physical cell size,
+  // which we get from the extents of the lat/lon data.
+  real_t area = 0.0, h = 0.0;
+  if (config.jigsaw._hfun_scal == JIGSAW_HFUN_RELATIVE) {
+    area = (real_t)estimate->num_masked_points;
+    h = config.jigsaw._hfun_hmax *
+        0.5 * (estimate->num_rows + estimate->num_cols);
+  } else {
+    // Only the extents of the lat/lon data matter, so we stream through them
+    // instead of reading them into memory.
+    real_t min_lat, max_lat, min_lon, max_lon;
+    size_t n_lat, n_lon;
+    result = scan_extent(config.lat_file, &n_lat, &min_lat, &max_lat);
+    if (!result.err_code) {
+      result = scan_extent(config.lon_file, &n_lon, &min_lon, &max_lon);
+    }
+    if (!result.err_code && ((n_lat != num_values) || (n_lon != num_values))) {
+      result = tdm_result(1,
+        "Number of lat/lon coordinates (%zd/%zd) != number of mask values (%zd).",
+        n_lat, n_lon, num_values);
+    }
+    if (!result.err_code) {
+      real_t dx_dlon, dy_dlat;
+      compute_neu_spacings(0.5 * (min_lat + max_lat), &dx_dlon, &dy_dlat);
+      real_t dx = fabs(dx_dlon * (max_lon - min_lon)) /
+                  ((estimate->num_cols > 1) ? estimate->num_cols - 1 : 1);
+      real_t dy = fabs(dy_dlat * (max_lat - min_lat)) /
+                  ((estimate->num_rows > 1) ? estimate->num_rows - 1 : 1);
+      area = dx * dy * estimate->num_masked_points;
+      h = config.jigsaw._hfun_hmax;
+    }
+    if (result.err_code) return result;
+  }
+  if (h <= 0.0) {
+    return tdm_result(1, "hfun_hmax must be positive to estimate mesh sizes.");
+  }
+
+  // Jigsaw produces nearly equilateral triangles with edge length h, and a
+  // planar triangulation has about half as many vertices as triangles.
+  real_t tri_area = 0.25 * sqrt(3.0) * h * h;
+  estimate->num_surface_triangles = (size_t)ceil(area / tri_area);
+  estimate->num_surface_vertices = estimate->num_surface_triangles / 2 + 2;
+  estimate->num_column_cells = estimate->num_surface_triangles *
+                               (size_t)((config.num_layers > 0) ? config.num_layers : 1);
+  size_t num_tris = estimate->num_surface_triangles;
+  size_t num_cells = estimate->num_column_cells;
+
+  // Reading data: files are streamed one at a time through a fixed ring of
+  // buffers into dem/lat/lon/mask (and cost) arrays, which coexist with the
+  // points. An array grows by doubling, so the last one read can briefly
+  // occupy twice its final size.
+  int num_files = (config.column_cost_file) ? 5 : 4;
+  size_t points_memory = sizeof(point_t) * num_values;
+  estimate->stage_memory[TDM_STAGE_READ] =
+    TDM_STREAM_MEMORY + (num_files + 1) * sizeof(real_t) * num_values +
+    points_memory;
+  estimate->stage_time[TDM_STAGE_READ] =
+    num_files * TDM_SECONDS_PER_TEXT_VALUE * num_values;
+
+  // Triangulation: points plus jigsaw's working set.
+  estimate->stage_memory[TDM_STAGE_TRIANGULATE] =
+    points_memory + TDM_BYTES_PER_TRIANGLE * num_tris;
+  estimate->stage_time[TDM_STAGE_TRIANGULATE] =
+    TDM_SECONDS_PER_TRIANGLE * num_tris;
+
+  // Extrusion: the surface and column meshes coexist.
+  estimate->stage_memory[TDM_STAGE_EXTRUDE] =
+    TDM_BYTES_PER_PLEX_CELL * (num_tris + num_cells);
+  estimate->stage_time[TDM_STAGE_EXTRUDE] =
+    TDM_SECONDS_PER_PLEX_CELL * num_cells;
+
+  // Output: the column mesh plus a comparably-sized output buffer.
+  estimate->stage_memory[TDM_STAGE_WRITE] =
+    2 * TDM_BYTES_PER_PLEX_CELL * num_cells;
+
+  // Finite-volume geometry is computed alongside the column mesh, and when
+  // the mesh is distributed, it's packed for every point of the serial mesh
+  // and unpacked from every point of the distributed mesh before the owned
+  // cells' geometry is extracted.
+  if (config.column_mesh_fv_geometry) {
+    size_t packed_memory = TDM_FV_BYTES_PER_PACKED_POINT *
+                           TDM_PLEX_POINTS_PER_CELL * num_cells;
+    estimate->stage_memory[TDM_STAGE_EXTRUDE] +=
+      TDM_FV_BYTES_PER_CELL * num_cells + packed_memory;
+    estimate->stage_memory[TDM_STAGE_WRITE] +=
+      TDM_FV_BYTES_PER_CELL * num_cells + packed_memory;
+    estimate->stage_time[TDM_STAGE_WRITE] +=
+      TDM_SECONDS_PER_OUTPUT_CELL * num_cells;
+  }
+  estimate->stage_time[TDM_STAGE_WRITE] =
+    TDM_SECONDS_PER_OUTPUT_CELL * (num_tris + num_cells);
+
+  for (int s = 0; s < TDM_NUM_STAGES; ++s) {
+    if (estimate->peak_memory < estimate->stage_memory[s]) {
+      estimate->peak_memory = estimate->stage_memory[s];
+    }
+    estimate->total_time += estimate->stage_time[s];
+  }
+
+  // Every rank reads all the data, triangulates, and extrudes, so the memory
+  // for those stages is needed on each rank no matter how many ranks we use.
+  // Only the distributed column mesh is divided among the ranks.
+  for (int s = TDM_STAGE_READ; s <= TDM_STAGE_EXTRUDE; ++s) {
+    if (estimate->serial_memory < estimate->stage_memory[s]) {
+      estimate->serial_memory = estimate->stage_memory[s];
+    }
+  }
+  size_t distributed_memory = estimate->stage_memory[TDM_STAGE_WRITE];
+
+  // Recommend enough ranks to hold the distributed column mesh and to keep
+  // the number of column cells on each rank reasonable.
+  size_t ranks_for_memory = (distributed_memory + TDM_MEMORY_PER_RANK - 1) /
+                            TDM_MEMORY_PER_RANK;
+  size_t ranks_for_cells = (num_cells + TDM_MAX_CELLS_PER_RANK - 1) /
+                           TDM_MAX_CELLS_PER_RANK;
+  size_t num_ranks = (ranks_for_memory > ranks_for_cells) ? ranks_for_memory
+                                                          : ranks_for_cells;
+  estimate->num_ranks = (num_ranks > 0) ? (int)num_ranks : 1;
+  estimate->memory_per_rank = TDM_MEMORY_PER_RANK;
+  estimate->rank_memory = (distributed_memory + estimate->num_ranks - 1) /
+                          estimate->num_ranks;
+  if (estimate->rank_memory < estimate->serial_memory) {
+    estimate->rank_memory = estimate->serial_memory;
+  }
+
+  return result;
+}
+
 tdm_result_t triangulate_dem(tdm_config_t config,
                              size_t       num_points,
                              point_t      points[num_points],
@@ -207,13 +613,2057 @@ tdm_result_t triangulate_dem(tdm_config_t config,
   return result;
 }
 
+// This macro calls a PETSc function, converting a nonzero error code to a
+// tdm_result_t and jumping to the calling function's "finished" label.
+#define PETSC_CHECK(call) \
+  { \
+    PetscErrorCode ierr_ = call; \
+    if (ierr_) { \
+      result = tdm_result(ierr_, "PETSc error %d in %s", ierr_, #call); \
+      goto finished; \
+    } \
+  }
+
+// The names under which finite-volume geometry and partitioning data are
+// attached to a column mesh.
+#define TDM_FV_GEOMETRY "tdm_fv_geometry"
+#define TDM_PARTITION   "tdm_partition"
+
+// Computes the depth of the top of each layer, and the thickness of each layer,
+// from the given configuration.
+static void get_layers(tdm_config_t config,
+                       PetscReal    depths[config.num_layers],
+                       PetscReal    thicknesses[config.num_layers]) {
+  PetscReal depth = 0.0;
+  for (int k = 0; k < config.num_layers; ++k) {
+    depths[k] = depth;
+    thicknesses[k] = (config.layer_thicknesses) ?
+                     config.layer_thicknesses[k] :
+                     config.total_layer_thickness / config.num_layers;
+    depth += thicknesses[k];
+  }
+}
+
+// Computes the geometry for all the prisms in the column beneath the surface
+// triangle with vertices x[0..2] and lateral edges (e[j][0], e[j][1]), storing
+// it in the given arrays, which point to the column's first cell. The geometry
+// of the triangle is computed once, and each layer is a simple (vectorizable)
+// affine function of its depth and thickness.
+static void compute_column_geometry(const PetscReal x[3][3],
+                                    const PetscReal e[3][2][3],
+                                    PetscInt        num_layers,
+                                    const PetscReal depths[num_layers],
+                                    const PetscReal thicknesses[num_layers],
+                                    PetscReal      *volumes,
+                                    PetscReal      *centroids,
+                                    PetscReal      *areas,
+                                    PetscReal      *normals) {
+  // Top triangle: centroid, area, unit normal (pointing up).
+  PetscReal c[3], a[3], b[3], n[3];
+  for (int d = 0; d < 3; ++d) {
+    c[d] = (x[0][d] + x[1][d] + x[2][d]) / 3.0;
+    a[d] = x[1][d] - x[0][d];
+    b[d] = x[2][d] - x[0][d];
+  }
+  n[0] = a[1]*b[2] - a[2]*b[1];
+  n[1] = a[2]*b[0] - a[0]*b[2];
+  n[2] = a[0]*b[1] - a[1]*b[0];
+  PetscReal n_mag = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+  PetscReal sign = (n[2] < 0.0) ? -1.0 : 1.0;
+  PetscReal top_area = 0.5 * n_mag;
+  PetscReal xy_area = 0.5 * fabs(n[2]); // area projected onto the x-y plane
+  for (int d = 0; d < 3; ++d) n[d] *= sign / n_mag;
+
+  // Lateral faces: horizontal lengths and unit (horizontal) outward normals.
+  PetscReal lengths[3], lateral_normals[3][2];
+  for (int j = 0; j < 3; ++j) {
+    PetscReal dx = e[j][1][0] - e[j][0][0], dy = e[j][1][1] - e[j][0][1];
+    lengths[j] = sqrt(dx*dx + dy*dy);
+    PetscReal nx = dy / lengths[j], ny = -dx / lengths[j];
+    PetscReal mx = 0.5 * (e[j][0][0] + e[j][1][0]) - c[0],
+              my = 0.5 * (e[j][0][1] + e[j][1][1]) - c[1];
+    if (nx*mx + ny*my < 0.0) {
+      nx = -nx;
+      ny = -ny;
+    }
+    lateral_normals[j][0] = nx;
+    lateral_normals[j][1] = ny;
+  }
+
+  // Each prism is its top triangle translated downward, so its volume is the
+  // projected area times its thickness, and its centroid sits halfway down.
+  for (PetscInt k = 0; k < num_layers; ++k) {
+    volumes[k] = xy_area * thicknesses[k];
+    centroids[3*k]   = c[0];
+    centroids[3*k+1] = c[1];
+    centroids[3*k+2] = c[2] - depths[k] - 0.5 * thicknesses[k];
+  }
+  for (PetscInt k = 0; k < num_layers; ++k) {
+    PetscReal *A = &areas[TDM_PRISM_NUM_FACES*k];
+    PetscReal *N = &normals[3*TDM_PRISM_NUM_FACES*k];
+    A[0] = A[1] = top_area;
+    N[0] =  n[0]; N[1] =  n[1]; N[2] =  n[2];
+    N[3] = -n[0]; N[4] = -n[1]; N[5] = -n[2];
+    for (int j = 0; j < 3; ++j) {
+      A[2+j] = lengths[j] * thicknesses[k];
+      N[6+3*j]   = lateral_normals[j][0];
+      N[6+3*j+1] = lateral_normals[j][1];
+      N[6+3*j+2] = 0.0;
+    }
+  }
+}
+
+// Retrieves the coordinates of the given vertex in the given mesh.
+static void get_vertex_coords(PetscSection      coord_section,
+                              const PetscScalar coords[],
+                              PetscInt          vertex,
+                              PetscReal         x[3]) {
+  PetscInt offset;
+  PetscSectionGetOffset(coord_section, vertex, &offset);
+  for (int d = 0; d < 3; ++d) x[d] = PetscRealPart(coords[offset+d]);
+}
+
+tdm_result_t compute_fv_geometry(tdm_config_t       config,
+                                 DM                 surface_mesh,
+                                 tdm_fv_geometry_t *geometry) {
+  tdm_result_t result = {};
+  *geometry = (tdm_fv_geometry_t){0};
+  PetscInt num_layers = config.num_layers;
+  PetscReal *depths = NULL, *thicknesses = NULL;
+  const PetscScalar *coords = NULL;
+  Vec coord_vec = NULL;
+
+  if (num_layers <= 0) {
+    return tdm_result(1, "Can't compute geometry for %" PetscInt_FMT " layers!",
+                      num_layers);
+  }
+
+  PetscInt dim;
+  PETSC_CHECK(DMGetCoordinateDim(surface_mesh, &dim));
+  if (dim != 3) {
+    return tdm_result(1, "Surface mesh has %" PetscInt_FMT "-D coordinates "
+                      "(expected 3-D).", dim);
+  }
+
+  PetscInt c_start, c_end;
+  PETSC_CHECK(DMPlexGetHeightStratum(surface_mesh, 0, &c_start, &c_end));
+  PetscInt num_tris = c_end - c_start;
+  PetscInt num_cells = num_tris * num_layers;
+
+  depths = malloc(sizeof(PetscReal) * num_layers);
+  thicknesses = malloc(sizeof(PetscReal) * num_layers);
+  get_layers(config, depths, thicknesses);
+
+  geometry->num_cells      = num_cells;
+  geometry->cell_volumes   = malloc(sizeof(PetscReal) * num_cells);
+  geometry->cell_centroids = malloc(sizeof(PetscReal) * 3 * num_cells);
+  geometry->face_areas     = malloc(sizeof(PetscReal) * TDM_PRISM_NUM_FACES *
+                                    num_cells);
+  geometry->face_normals   = malloc(sizeof(PetscReal) * 3 * TDM_PRISM_NUM_FACES *
+                                    num_cells);
+  geometry->cell_neighbors = malloc(sizeof(PetscInt) * TDM_PRISM_NUM_FACES *
+                                    num_cells);
+
+  PetscSection coord_section;
+  PETSC_CHECK(DMGetCoordinateSection(surface_mesh, &coord_section));
+  PETSC_CHECK(DMGetCoordinatesLocal(surface_mesh, &coord_vec));
+  PETSC_CHECK(VecGetArrayRead(coord_vec, &coords));
+
+  PetscInt v_start, v_end;
+  PETSC_CHECK(DMPlexGetDepthStratum(surface_mesh, 0, &v_start, &v_end));
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt t = c - c_start;
+
+    // Gather the triangle's vertices (in order) from its closure.
+    PetscInt closure_size, *closure = NULL;
+    PETSC_CHECK(DMPlexGetTransitiveClosure(surface_mesh, c, PETSC_TRUE,
+                                           &closure_size, &closure));
+    PetscReal x[3][3];
+    int nv = 0;
+    for (PetscInt i = 0; i < closure_size; ++i) {
+      PetscInt p = closure[2*i];
+      if ((p >= v_start) && (p < v_end) && (nv < 3)) {
+        get_vertex_coords(coord_section, coords, p, x[nv]);
+        ++nv;
+      }
+    }
+    PETSC_CHECK(DMPlexRestoreTransitiveClosure(surface_mesh, c, PETSC_TRUE,
+                                               &closure_size, &closure));
+    if (nv != 3) {
+      result = tdm_result(1, "Surface cell %" PetscInt_FMT " is not a triangle!",
+                          c);
+      goto finished;
+    }
+
+    // Each edge of the triangle yields a lateral face, and its other
+    // supporting cell (if any) is the neighboring column.
+    const PetscInt *edges;
+    PetscReal e[3][2][3];
+    PetscInt neighbors[3];
+    PETSC_CHECK(DMPlexGetCone(surface_mesh, c, &edges));
+    for (int j = 0; j < 3; ++j) {
+      const PetscInt *verts, *support;
+      PetscInt support_size;
+      PETSC_CHECK(DMPlexGetCone(surface_mesh, edges[j], &verts));
+      get_vertex_coords(coord_section, coords, verts[0], e[j][0]);
+      get_vertex_coords(coord_section, coords, verts[1], e[j][1]);
+      PETSC_CHECK(DMPlexGetSupportSize(surface_mesh, edges[j], &support_size));
+      PETSC_CHECK(DMPlexGetSupport(surface_mesh, edges[j], &support));
+      neighbors[j] = -1;
+      for (PetscInt i = 0; i < support_size; ++i) {
+        if (support[i] != c) neighbors[j] = support[i] - c_start;
+      }
+    }
+
+    PetscInt first = t * num_layers;
+    compute_column_geometry(x, e, num_layers, depths, thicknesses,
+                            &geometry->cell_volumes[first],
+                            &geometry->cell_centroids[3*first],
+                            &geometry->face_areas[TDM_PRISM_NUM_FACES*first],
+                            &geometry->face_normals[3*TDM_PRISM_NUM_FACES*first]);
+
+    // Cell-face adjacency.
+    for (PetscInt k = 0; k < num_layers; ++k) {
+      PetscInt *N = &geometry->cell_neighbors[TDM_PRISM_NUM_FACES*(first+k)];
+      N[0] = (k > 0) ? first + k - 1 : -1;
+      N[1] = (k < num_layers - 1) ? first + k + 1 : -1;
+      for (int j = 0; j < 3; ++j) {
+        N[2+j] = (neighbors[j] >= 0) ? neighbors[j] * num_layers + k : -1;
+      }
+    }
+  }
+
+finished:
+  if (coords) VecRestoreArrayRead(coord_vec, &coords);
+  if (depths) free(depths);
+  if (thicknesses) free(thicknesses);
+  if (result.err_code) destroy_fv_geometry(geometry);
+  return result;
+}
+
+void destroy_fv_geometry(tdm_fv_geometry_t *geometry) {
+  if (geometry->cell_volumes) free(geometry->cell_volumes);
+  if (geometry->cell_centroids) free(geometry->cell_centroids);
+  if (geometry->face_areas) free(geometry->face_areas);
+  if (geometry->face_normals) free(geometry->face_normals);
+  if (geometry->cell_neighbors) free(geometry->cell_neighbors);
+  *geometry = (tdm_fv_geometry_t){0};
+}
+
+// Destroys finite-volume geometry attached to a mesh via a PetscContainer.
+static PetscErrorCode destroy_attached_fv_geometry(void *context) {
+  tdm_fv_geometry_t *geometry = context;
+  destroy_fv_geometry(geometry);
+  free(geometry);
+  return 0;
+}
+
+// Destroys a partition attached to a mesh via a PetscContainer.
+static PetscErrorCode destroy_attached_partition(void *context) {
+  tdm_partition_t *partition = context;
+  destroy_partition(partition);
+  free(partition);
+  return 0;
+}
+
+// Attaches the given data to the given mesh under the given name, using the
+// given function to destroy the data along with the mesh.
+static tdm_result_t attach_data(DM              mesh,
+                                const char     *name,
+                                void           *data,
+                                PetscErrorCode (*destroy)(void*)) {
+  tdm_result_t result = {};
+  PetscContainer container = NULL;
+  PETSC_CHECK(PetscContainerCreate(PETSC_COMM_SELF, &container));
+  PETSC_CHECK(PetscContainerSetPointer(container, data));
+  PETSC_CHECK(PetscContainerSetUserDestroy(container, destroy));
+  PETSC_CHECK(PetscObjectCompose((PetscObject)mesh, name,
+                                 (PetscObject)container));
+finished:
+  if (container) PetscContainerDestroy(&container);
+  return result;
+}
+
+// Retrieves the data attached to the given mesh under the given name, or NULL
+// if there is no such data.
+static tdm_result_t get_attached_data(DM          mesh,
+                                      const char *name,
+                                      void      **data) {
+  tdm_result_t result = {};
+  PetscContainer container = NULL;
+  *data = NULL;
+  PETSC_CHECK(PetscObjectQuery((PetscObject)mesh, name,
+                               (PetscObject*)&container));
+  if (container) {
+    PETSC_CHECK(PetscContainerGetPointer(container, data));
+  }
+finished:
+  return result;
+}
+
 tdm_result_t extrude_surface_mesh(tdm_config_t config,
                                   DM           surface_mesh,
                                   DM          *column_mesh) {
-  return (tdm_result_t){0};
+  tdm_result_t result = {};
+  *column_mesh = NULL;
+
+  // Extrude downward from the surface. Layer thicknesses start at the top.
+  const PetscReal normal[3] = {0.0, 0.0, -1.0};
+  PETSC_CHECK(DMPlexExtrude(surface_mesh, config.num_layers,
+                            config.total_layer_thickness, PETSC_TRUE,
+                            PETSC_FALSE, PETSC_FALSE, normal,
+                            config.layer_thicknesses,
+#if PETSC_VERSION_GE(3, 21, 0)
+                            NULL, // all cells are extruded
+#endif
+                            column_mesh));
+
+  // Attach finite-volume geometry if requested.
+  if (config.column_mesh_fv_geometry) {
+    tdm_fv_geometry_t *geometry = malloc(sizeof(tdm_fv_geometry_t));
+    result = compute_fv_geometry(config, surface_mesh, geometry);
+    if (result.err_code) {
+      free(geometry);
+      goto finished;
+    }
+    result = attach_data(*column_mesh, TDM_FV_GEOMETRY, geometry,
+                         destroy_attached_fv_geometry);
+    if (result.err_code) {
+      destroy_attached_fv_geometry(geometry);
+    }
+  }
+
+finished:
+  if (result.err_code && *column_mesh) DMDestroy(column_mesh);
+  return result;
 }
 
-tdm_result_t write_mesh(tdm_config_t config, DM mesh, const char *prefix) {
-  return (tdm_result_t){0};
+// A column (surface triangle) ghosted to a rank.
+typedef struct ghost_column_t {
+  PetscInt rank, column;
+} ghost_column_t;
+
+// Orders ghost columns by rank, then by column.
+static int compare_ghost_columns(const void *a, const void *b) {
+  const ghost_column_t *ga = a, *gb = b;
+  if (ga->rank != gb->rank) return (ga->rank < gb->rank) ? -1 : 1;
+  if (ga->column != gb->column) return (ga->column < gb->column) ? -1 : 1;
+  return 0;
+}
+
+void build_partition(int              num_ranks,
+                     PetscInt         num_layers,
+                     PetscInt         num_columns,
+                     const PetscInt   column_owners[num_columns],
+                     const PetscInt   offsets[num_columns+1],
+                     const PetscInt   adjacency[],
+                     tdm_partition_t *partition) {
+  PetscInt L = num_layers;
+  PetscInt num_cells = num_columns * L;
+  partition->num_ranks = num_ranks;
+  partition->num_cells = num_cells;
+
+  // Owned cells, grouped by rank.
+  partition->cell_owners = malloc(sizeof(PetscInt) * num_cells);
+  partition->owned_offsets = calloc(num_ranks+1, sizeof(PetscInt));
+  partition->owned_cells = malloc(sizeof(PetscInt) * num_cells);
+  for (PetscInt t = 0; t < num_columns; ++t) {
+    for (PetscInt k = 0; k < L; ++k) {
+      partition->cell_owners[t*L+k] = column_owners[t];
+    }
+    partition->owned_offsets[column_owners[t]+1] += L;
+  }
+  for (int r = 0; r < num_ranks; ++r) {
+    partition->owned_offsets[r+1] += partition->owned_offsets[r];
+  }
+  PetscInt *pos = malloc(sizeof(PetscInt) * num_ranks);
+  memcpy(pos, partition->owned_offsets, sizeof(PetscInt) * num_ranks);
+  for (PetscInt t = 0; t < num_columns; ++t) {
+    PetscInt r = column_owners[t];
+    for (PetscInt k = 0; k < L; ++k) {
+      partition->owned_cells[pos[r]++] = t*L+k;
+    }
+  }
+  free(pos);
+
+  // A column is ghosted to a rank if it's owned by another rank and shares a
+  // face with one of that rank's columns. Since columns aren't split, every
+  // ghost cell sits beside an owned cell in the same layer.
+  size_t num_ghosts = 0, cap = 1024;
+  ghost_column_t *ghosts = malloc(sizeof(ghost_column_t) * cap);
+  for (PetscInt t = 0; t < num_columns; ++t) {
+    for (PetscInt i = offsets[t]; i < offsets[t+1]; ++i) {
+      PetscInt u = adjacency[i];
+      if (column_owners[u] != column_owners[t]) {
+        if (num_ghosts == cap) {
+          cap *= 2;
+          ghosts = realloc(ghosts, sizeof(ghost_column_t) * cap);
+        }
+        ghosts[num_ghosts++] = (ghost_column_t){column_owners[t], u};
+      }
+    }
+  }
+  qsort(ghosts, num_ghosts, sizeof(ghost_column_t), compare_ghost_columns);
+  size_t num_unique = 0;
+  for (size_t i = 0; i < num_ghosts; ++i) {
+    if ((num_unique == 0) ||
+        compare_ghost_columns(&ghosts[i], &ghosts[num_unique-1])) {
+      ghosts[num_unique++] = ghosts[i];
+    }
+  }
+
+  partition->ghost_offsets = calloc(num_ranks+1, sizeof(PetscInt));
+  partition->ghost_cells = malloc(sizeof(PetscInt) * (num_unique * L + 1));
+  partition->ghost_owners = malloc(sizeof(PetscInt) * (num_unique * L + 1));
+  for (size_t i = 0; i < num_unique; ++i) {
+    PetscInt u = ghosts[i].column;
+    partition->ghost_offsets[ghosts[i].rank+1] += L;
+    for (PetscInt k = 0; k < L; ++k) {
+      partition->ghost_cells[i*L+k] = u*L+k;
+      partition->ghost_owners[i*L+k] = column_owners[u];
+    }
+  }
+  for (int r = 0; r < num_ranks; ++r) {
+    partition->ghost_offsets[r+1] += partition->ghost_offsets[r];
+  }
+  free(ghosts);
+}
+
+// Partitioning weights are integers, so we scale relative costs by this
+// factor before rounding them. Graph partitioners sum the weights in (often
+// 32-bit) integers, so the scale is reduced as needed to keep the total weight
+// of a graph below TDM_MAX_TOTAL_WEIGHT.
+#define TDM_WEIGHT_SCALE 100
+#define TDM_MAX_TOTAL_WEIGHT (1 << 30)
+
+// Computes the relative cost of each column of the column mesh extruded from
+// the given surface mesh: the cost of the point nearest the centroid of the
+// column's surface triangle, divided by the mean cost of all columns.
+static tdm_result_t compute_column_costs(size_t    num_points,
+                                         point_t   points[num_points],
+                                         DM        surface_mesh,
+                                         PetscInt *num_columns,
+                                         real_t  **column_costs) {
+  tdm_result_t result = {};
+  const PetscScalar *coords = NULL;
+  Vec coord_vec = NULL;
+  tdm_point_grid_t grid = {0};
+  *column_costs = NULL;
+
+  PetscInt c_start, c_end, v_start, v_end;
+  PETSC_CHECK(DMPlexGetHeightStratum(surface_mesh, 0, &c_start, &c_end));
+  PETSC_CHECK(DMPlexGetDepthStratum(surface_mesh, 0, &v_start, &v_end));
+  *num_columns = c_end - c_start;
+  real_t *costs = *column_costs = malloc(sizeof(real_t) * (*num_columns + 1));
+
+  PetscSection coord_section;
+  PETSC_CHECK(DMGetCoordinateSection(surface_mesh, &coord_section));
+  PETSC_CHECK(DMGetCoordinatesLocal(surface_mesh, &coord_vec));
+  PETSC_CHECK(VecGetArrayRead(coord_vec, &coords));
+
+  tdm_point_grid_build(num_points, points, &grid);
+  real_t total_cost = 0.0;
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt closure_size, *closure = NULL;
+    PETSC_CHECK(DMPlexGetTransitiveClosure(surface_mesh, c, PETSC_TRUE,
+                                           &closure_size, &closure));
+    PetscReal centroid[3] = {0.0, 0.0, 0.0}, x[3];
+    int nv = 0;
+    for (PetscInt i = 0; i < closure_size; ++i) {
+      PetscInt p = closure[2*i];
+      if ((p >= v_start) && (p < v_end)) {
+        get_vertex_coords(coord_section, coords, p, x);
+        for (int d = 0; d < 3; ++d) centroid[d] += x[d];
+        ++nv;
+      }
+    }
+    PETSC_CHECK(DMPlexRestoreTransitiveClosure(surface_mesh, c, PETSC_TRUE,
+                                               &closure_size, &closure));
+    real_t cost = 1.0;
+    if ((num_points > 0) && (nv > 0)) {
+      size_t p = tdm_point_grid_nearest(&grid, points, centroid[0] / nv,
+                                        centroid[1] / nv);
+      cost = points[p].cost;
+    }
+    costs[c - c_start] = cost;
+    total_cost += cost;
+  }
+
+  real_t mean_cost = (*num_columns > 0) ? total_cost / *num_columns : 1.0;
+  if (mean_cost <= 0.0) mean_cost = 1.0;
+  for (PetscInt t = 0; t < *num_columns; ++t) {
+    costs[t] /= mean_cost;
+  }
+
+finished:
+  if (coords) VecRestoreArrayRead(coord_vec, &coords);
+  tdm_point_grid_destroy(&grid);
+  if (result.err_code && *column_costs) {
+    free(*column_costs);
+    *column_costs = NULL;
+  }
+  return result;
+}
+
+// Converts the given relative costs (with mean 1) of num_vertices graph
+// vertices to positive integer weights, for a graph in which each vertex
+// appears num_copies times (e.g. once per layer), so that the total weight of
+// that graph stays below TDM_MAX_TOTAL_WEIGHT.
+static void compute_weights(PetscInt     num_vertices,
+                            const real_t costs[num_vertices],
+                            PetscInt     num_copies,
+                            PetscInt     weights[num_vertices]) {
+  // The costs sum to num_vertices, and rounding adds at most 1 per copy of
+  // each vertex, so we leave room for that.
+  real_t total = (real_t)num_vertices * num_copies;
+  real_t scale = TDM_WEIGHT_SCALE;
+  if ((total > 0.0) && (scale * total > 0.5 * TDM_MAX_TOTAL_WEIGHT)) {
+    scale = 0.5 * TDM_MAX_TOTAL_WEIGHT / total;
+  }
+  for (PetscInt v = 0; v < num_vertices; ++v) {
+    PetscInt w = (PetscInt)round(scale * costs[v]);
+    weights[v] = (w > 0) ? w : 1;
+  }
+}
+
+// Partitions the given graph (in PetscPartitioner's CSR format) into nparts
+// parts, using whatever partitioner is selected by PETSc's options
+// (-petscpartitioner_type) and the given vertex weights (if any). The part
+// owning each vertex is stored in owners.
+static tdm_result_t partition_graph(MPI_Comm       comm,
+                                    PetscInt       nparts,
+                                    PetscInt       num_vertices,
+                                    PetscInt       offsets[],
+                                    PetscInt       adjacency[],
+                                    const PetscInt weights[],
+                                    PetscInt       owners[]) {
+  tdm_result_t result = {};
+  PetscPartitioner partitioner = NULL;
+  PetscSection vertex_section = NULL, part_section = NULL;
+  IS vertices_is = NULL;
+  const PetscInt *vertices = NULL;
+
+  if (weights) {
+    PETSC_CHECK(PetscSectionCreate(PETSC_COMM_SELF, &vertex_section));
+    PETSC_CHECK(PetscSectionSetChart(vertex_section, 0, num_vertices));
+    for (PetscInt v = 0; v < num_vertices; ++v) {
+      PETSC_CHECK(PetscSectionSetDof(vertex_section, v, weights[v]));
+    }
+    PETSC_CHECK(PetscSectionSetUp(vertex_section));
+  }
+
+  PETSC_CHECK(PetscPartitionerCreate(comm, &partitioner));
+  PETSC_CHECK(PetscPartitionerSetFromOptions(partitioner));
+  PETSC_CHECK(PetscSectionCreate(comm, &part_section));
+  PETSC_CHECK(PetscPartitionerPartition(partitioner, nparts, num_vertices,
+                                        offsets, adjacency, vertex_section,
+#if PETSC_VERSION_GE(3, 21, 0)
+                                        NULL, // edge weights
+#endif
+                                        NULL, // target partition weights
+                                        part_section, &vertices_is));
+
+  // The partition lists the vertices owned by each part contiguously.
+  PETSC_CHECK(ISGetIndices(vertices_is, &vertices));
+  for (PetscInt r = 0; r < nparts; ++r) {
+    PetscInt num_owned, offset;
+    PETSC_CHECK(PetscSectionGetDof(part_section, r, &num_owned));
+    PETSC_CHECK(PetscSectionGetOffset(part_section, r, &offset));
+    for (PetscInt i = offset; i < offset + num_owned; ++i) {
+      owners[vertices[i]] = r;
+    }
+  }
+
+finished:
+  if (vertices) ISRestoreIndices(vertices_is, &vertices);
+  if (vertices_is) ISDestroy(&vertices_is);
+  if (part_section) PetscSectionDestroy(&part_section);
+  if (vertex_section) PetscSectionDestroy(&vertex_section);
+  if (partitioner) PetscPartitionerDestroy(&partitioner);
+  return result;
 }
 
+// This type holds the pieces of a column partition of a column mesh: the
+// adjacency graph of its columns, their costs and weights, and their owning
+// ranks.
+typedef struct column_partition_t {
+  PetscInt  num_columns;
+  PetscInt *offsets, *adjacency; // CSR adjacency graph of the columns
+  IS        global_numbering;
+  real_t   *column_costs;        // relative cost of each column (mean 1)
+  PetscInt *column_weights;      // partitioning weight of each column
+  PetscInt *column_owners;       // rank owning each column
+} column_partition_t;
+
+static void destroy_column_partition(column_partition_t *partition) {
+  if (partition->offsets) PetscFree(partition->offsets);
+  if (partition->adjacency) PetscFree(partition->adjacency);
+  if (partition->global_numbering) ISDestroy(&partition->global_numbering);
+  if (partition->column_costs) free(partition->column_costs);
+  if (partition->column_weights) free(partition->column_weights);
+  if (partition->column_owners) free(partition->column_owners);
+  *partition = (column_partition_t){0};
+}
+
+// Partitions the columns of the column mesh extruded from the given surface
+// mesh among nparts ranks, weighting each column by its cost. (Every column
+// has the same number of layers, so that doesn't affect the partition.)
+static tdm_result_t partition_columns(tdm_config_t        config,
+                                      size_t              num_points,
+                                      point_t             points[num_points],
+                                      DM                  surface_mesh,
+                                      PetscInt            nparts,
+                                      column_partition_t *partition) {
+  tdm_result_t result = {};
+  *partition = (column_partition_t){0};
+
+  MPI_Comm comm;
+  PETSC_CHECK(PetscObjectGetComm((PetscObject)surface_mesh, &comm));
+  PETSC_CHECK(DMPlexCreatePartitionerGraph(surface_mesh, 0,
+                                           &partition->num_columns,
+                                           &partition->offsets,
+                                           &partition->adjacency,
+                                           &partition->global_numbering));
+  PetscInt num_columns = partition->num_columns;
+  if ((num_columns > 0) && (num_columns < nparts)) {
+    result = tdm_result(1, "Can't partition %" PetscInt_FMT " columns among "
+                        "%" PetscInt_FMT " ranks!", num_columns, nparts);
+    goto finished;
+  }
+
+  result = compute_column_costs(num_points, points, surface_mesh,
+                                &num_columns, &partition->column_costs);
+  if (result.err_code) goto finished;
+  partition->column_weights = malloc(sizeof(PetscInt) * (num_columns + 1));
+  compute_weights(num_columns, partition->column_costs, 1,
+                  partition->column_weights);
+
+  partition->column_owners = malloc(sizeof(PetscInt) * (num_columns + 1));
+  result = partition_graph(comm, nparts, num_columns, partition->offsets,
+                           partition->adjacency, partition->column_weights,
+                           partition->column_owners);
+
+finished:
+  if (result.err_code) destroy_column_partition(partition);
+  return result;
+}
+
+// Computes the edge cut (the number of graph edges between vertices in
+// different parts) and load imbalance (maximum over mean part weight) of a
+// partitioned graph, summed over all ranks in the given communicator.
+static tdm_result_t compute_partition_quality(MPI_Comm       comm,
+                                              PetscInt       nparts,
+                                              PetscInt       num_vertices,
+                                              const PetscInt offsets[],
+                                              const PetscInt adjacency[],
+                                              const PetscInt weights[],
+                                              const PetscInt owners[],
+                                              long long     *edge_cut,
+                                              double        *imbalance) {
+  long long cut = 0;
+  double *loads = calloc(nparts, sizeof(double));
+  for (PetscInt v = 0; v < num_vertices; ++v) {
+    loads[owners[v]] += weights[v];
+    for (PetscInt i = offsets[v]; i < offsets[v+1]; ++i) {
+      if (owners[adjacency[i]] != owners[v]) ++cut;
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &cut, 1, MPI_LONG_LONG, MPI_SUM, comm);
+  MPI_Allreduce(MPI_IN_PLACE, loads, (int)nparts, MPI_DOUBLE, MPI_SUM, comm);
+  double max_load = 0.0, total_load = 0.0;
+  for (PetscInt r = 0; r < nparts; ++r) {
+    if (max_load < loads[r]) max_load = loads[r];
+    total_load += loads[r];
+  }
+  free(loads);
+  *edge_cut = cut / 2; // each edge appears twice in the graph
+  *imbalance = (total_load > 0.0) ? max_load * nparts / total_load : 1.0;
+  return (tdm_result_t){0};
+}
+
+// Reports the edge cut and load imbalance of the given column partition of the
+// given column mesh, alongside those of a partition of the mesh's 3D cell graph
+// computed with the same costs.
+static tdm_result_t report_partition_quality(tdm_config_t        config,
+                                             DM                  column_mesh,
+                                             PetscInt            nparts,
+                                             column_partition_t *columns) {
+  tdm_result_t result = {};
+  PetscInt num_cells, *offsets = NULL, *adjacency = NULL;
+  PetscInt *layer_weights = NULL, *weights = NULL, *owners = NULL;
+  IS global_numbering = NULL;
+  PetscInt L = config.num_layers;
+
+  MPI_Comm comm;
+  PETSC_CHECK(PetscObjectGetComm((PetscObject)column_mesh, &comm));
+
+  // Column partition: lateral faces between columns on different ranks are
+  // cut in every layer, and no vertical faces are cut.
+  long long column_cut;
+  double column_imbalance;
+  result = compute_partition_quality(comm, nparts, columns->num_columns,
+                                     columns->offsets, columns->adjacency,
+                                     columns->column_weights,
+                                     columns->column_owners,
+                                     &column_cut, &column_imbalance);
+  if (result.err_code) goto finished;
+  column_cut *= L;
+
+  // 3D partition: cells are numbered column by column, and each of the L
+  // cells in a column gets the column's cost.
+  PETSC_CHECK(DMPlexCreatePartitionerGraph(column_mesh, 0, &num_cells,
+                                           &offsets, &adjacency,
+                                           &global_numbering));
+  layer_weights = malloc(sizeof(PetscInt) * (columns->num_columns + 1));
+  compute_weights(columns->num_columns, columns->column_costs, L,
+                  layer_weights);
+  weights = malloc(sizeof(PetscInt) * (num_cells + 1));
+  owners = malloc(sizeof(PetscInt) * (num_cells + 1));
+  for (PetscInt c = 0; c < num_cells; ++c) {
+    weights[c] = layer_weights[c / L];
+  }
+  result = partition_graph(comm, nparts, num_cells, offsets, adjacency,
+                           weights, owners);
+  if (result.err_code) goto finished;
+  long long cut_3d;
+  double imbalance_3d;
+  result = compute_partition_quality(comm, nparts, num_cells, offsets,
+                                     adjacency, weights, owners,
+                                     &cut_3d, &imbalance_3d);
+  if (result.err_code) goto finished;
+  long long split_columns = 0;
+  for (PetscInt t = 0; t < num_cells / L; ++t) {
+    for (PetscInt k = 1; k < L; ++k) {
+      if (owners[t*L+k] != owners[t*L]) {
+        ++split_columns;
+        break;
+      }
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &split_columns, 1, MPI_LONG_LONG, MPI_SUM, comm);
+
+  PetscPrintf(comm, "Partition quality (%" PetscInt_FMT " parts):\n", nparts);
+  PetscPrintf(comm, "  %-18s %14s %10s %14s\n", "", "edge cut", "imbalance",
+              "split columns");
+  PetscPrintf(comm, "  %-18s %14lld %10.3f %14d\n", "column partition",
+              column_cut, column_imbalance, 0);
+  PetscPrintf(comm, "  %-18s %14lld %10.3f %14lld\n", "3D partition",
+              cut_3d, imbalance_3d, split_columns);
+
+finished:
+  if (global_numbering) ISDestroy(&global_numbering);
+  if (offsets) PetscFree(offsets);
+  if (adjacency) PetscFree(adjacency);
+  if (layer_weights) free(layer_weights);
+  if (weights) free(weights);
+  if (owners) free(owners);
+  return result;
+}
+
+tdm_result_t partition_column_mesh(tdm_config_t config,
+                                   size_t       num_points,
+                                   point_t      points[num_points],
+                                   DM           surface_mesh,
+                                   DM           column_mesh) {
+  tdm_result_t result = {};
+  tdm_partition_t *partition = NULL;
+
+  if (config.num_ranks <= 0) {
+    return tdm_result(1, "Invalid number of ranks for partitioning: %d",
+                      config.num_ranks);
+  }
+
+  column_partition_t columns;
+  result = partition_columns(config, num_points, points, surface_mesh,
+                             config.num_ranks, &columns);
+  if (result.err_code) return result;
+
+  // Project the partition onto the prisms and compute the overlap.
+  partition = calloc(1, sizeof(tdm_partition_t));
+  build_partition(config.num_ranks, config.num_layers, columns.num_columns,
+                  columns.column_owners, columns.offsets, columns.adjacency,
+                  partition);
+  result = attach_data(column_mesh, TDM_PARTITION, partition,
+                       destroy_attached_partition);
+  if (result.err_code) goto finished;
+  partition = NULL; // the mesh owns it now
+
+  if (config.compare_partitions) {
+    result = report_partition_quality(config, column_mesh, config.num_ranks,
+                                      &columns);
+  }
+
+finished:
+  if (partition) destroy_attached_partition(partition);
+  destroy_column_partition(&columns);
+  return result;
+}
+
+// A cell of a distributed mesh, identified by its index in the serial mesh and
+// by its global number in the distributed mesh.
+typedef struct migrated_cell_t {
+  PetscInt serial_index, global_number;
+} migrated_cell_t;
+
+static int compare_migrated_cells(const void *a, const void *b) {
+  const migrated_cell_t *ca = a, *cb = b;
+  return (ca->serial_index < cb->serial_index) ? -1 :
+         (ca->serial_index > cb->serial_index) ? 1 : 0;
+}
+
+// Migrates the finite-volume geometry of the given column mesh to the mesh
+// distributed from it with the given point migration SF from DMPlexDistribute.
+// The migrated geometry covers only the cells owned by this rank, in local
+// order, with neighbors given by their global cell numbers in the distributed
+// mesh, so it lines up with the cells written by DMView.
+static tdm_result_t migrate_fv_geometry(DM                 column_mesh,
+                                        tdm_fv_geometry_t *geometry,
+                                        PetscSF            migration_sf,
+                                        DM                 distributed_mesh,
+                                        tdm_fv_geometry_t *migrated) {
+  tdm_result_t result = {};
+  *migrated = (tdm_fv_geometry_t){0};
+  PetscReal *root_reals = NULL, *leaf_reals = NULL;
+  PetscInt *root_ints = NULL, *leaf_ints = NULL;
+  migrated_cell_t *cells = NULL;
+  IS numbering_is = NULL;
+  const PetscInt *numbering = NULL;
+  MPI_Datatype real_type = MPI_DATATYPE_NULL, int_type = MPI_DATATYPE_NULL;
+  const int NR = TDM_FV_CELL_NUM_REALS, NI = TDM_FV_CELL_NUM_INTS,
+            NF = TDM_PRISM_NUM_FACES;
+
+  // Pack the geometry of each of our cells (the roots of the SF).
+  PetscInt num_roots, c_start, c_end;
+  PETSC_CHECK(PetscSFGetGraph(migration_sf, &num_roots, NULL, NULL, NULL));
+  PETSC_CHECK(DMPlexGetHeightStratum(column_mesh, 0, &c_start, &c_end));
+  root_reals = calloc(NR * num_roots + 1, sizeof(PetscReal));
+  root_ints = malloc(sizeof(PetscInt) * (NI * num_roots + 1));
+  for (PetscInt i = 0; i < NI * num_roots; ++i) root_ints[i] = -1;
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt i = c - c_start;
+    PetscReal *R = &root_reals[NR*c];
+    PetscInt *I = &root_ints[NI*c];
+    R[0] = geometry->cell_volumes[i];
+    for (int d = 0; d < 3; ++d) R[1+d] = geometry->cell_centroids[3*i+d];
+    for (int f = 0; f < NF; ++f) {
+      R[4+f] = geometry->face_areas[NF*i+f];
+      for (int d = 0; d < 3; ++d) {
+        R[4+NF+3*f+d] = geometry->face_normals[3*(NF*i+f)+d];
+      }
+      I[1+f] = geometry->cell_neighbors[NF*i+f];
+    }
+    I[0] = i;
+  }
+
+  // Send it to the distributed mesh's points (the leaves).
+  PetscInt p_start, p_end;
+  PETSC_CHECK(DMPlexGetChart(distributed_mesh, &p_start, &p_end));
+  leaf_reals = calloc(NR * p_end + 1, sizeof(PetscReal));
+  leaf_ints = malloc(sizeof(PetscInt) * (NI * p_end + 1));
+  for (PetscInt i = 0; i < NI * p_end; ++i) leaf_ints[i] = -1;
+  MPI_Type_contiguous(NR, MPIU_REAL, &real_type);
+  MPI_Type_commit(&real_type);
+  MPI_Type_contiguous(NI, MPIU_INT, &int_type);
+  MPI_Type_commit(&int_type);
+  PETSC_CHECK(PetscSFBcastBegin(migration_sf, real_type, root_reals,
+                                leaf_reals, MPI_REPLACE));
+  PETSC_CHECK(PetscSFBcastEnd(migration_sf, real_type, root_reals,
+                              leaf_reals, MPI_REPLACE));
+  PETSC_CHECK(PetscSFBcastBegin(migration_sf, int_type, root_ints,
+                                leaf_ints, MPI_REPLACE));
+  PETSC_CHECK(PetscSFBcastEnd(migration_sf, int_type, root_ints,
+                              leaf_ints, MPI_REPLACE));
+
+  // Map serial cell indices to global cell numbers for all local cells
+  // (including overlap cells, whose numbers are encoded as -(number+1)).
+  PETSC_CHECK(DMPlexGetHeightStratum(distributed_mesh, 0, &c_start, &c_end));
+  PETSC_CHECK(DMPlexGetCellNumbering(distributed_mesh, &numbering_is));
+  PETSC_CHECK(ISGetIndices(numbering_is, &numbering));
+  PetscInt num_local = c_end - c_start, num_owned = 0;
+  cells = malloc(sizeof(migrated_cell_t) * (num_local + 1));
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt number = numbering[c - c_start];
+    if (number >= 0) ++num_owned;
+    cells[c - c_start] = (migrated_cell_t){
+      .serial_index = leaf_ints[NI*c],
+      .global_number = (number >= 0) ? number : -(number + 1)
+    };
+  }
+  qsort(cells, num_local, sizeof(migrated_cell_t), compare_migrated_cells);
+
+  // Unpack the owned cells.
+  migrated->num_cells      = num_owned;
+  migrated->cell_volumes   = malloc(sizeof(PetscReal) * (num_owned + 1));
+  migrated->cell_centroids = malloc(sizeof(PetscReal) * (3 * num_owned + 1));
+  migrated->face_areas     = malloc(sizeof(PetscReal) * (NF * num_owned + 1));
+  migrated->face_normals   = malloc(sizeof(PetscReal) *
+                                    (3 * NF * num_owned + 1));
+  migrated->cell_neighbors = malloc(sizeof(PetscInt) * (NF * num_owned + 1));
+  PetscInt i = 0;
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    if (numbering[c - c_start] < 0) continue;
+    const PetscReal *R = &leaf_reals[NR*c];
+    const PetscInt *I = &leaf_ints[NI*c];
+    migrated->cell_volumes[i] = R[0];
+    for (int d = 0; d < 3; ++d) migrated->cell_centroids[3*i+d] = R[1+d];
+    for (int f = 0; f < NF; ++f) {
+      migrated->face_areas[NF*i+f] = R[4+f];
+      for (int d = 0; d < 3; ++d) {
+        migrated->face_normals[3*(NF*i+f)+d] = R[4+NF+3*f+d];
+      }
+      PetscInt neighbor = -1;
+      if (I[1+f] >= 0) {
+        migrated_cell_t key = {.serial_index = I[1+f]};
+        migrated_cell_t *found = bsearch(&key, cells, num_local,
+                                         sizeof(migrated_cell_t),
+                                         compare_migrated_cells);
+        if (!found) {
+          result = tdm_result(1, "Neighbor of cell %" PetscInt_FMT " is "
+                              "missing from the one-cell overlap!", c);
+          goto finished;
+        }
+        neighbor = found->global_number;
+      }
+      migrated->cell_neighbors[NF*i+f] = neighbor;
+    }
+    ++i;
+  }
+
+finished:
+  if (numbering) ISRestoreIndices(numbering_is, &numbering);
+  if (real_type != MPI_DATATYPE_NULL) MPI_Type_free(&real_type);
+  if (int_type != MPI_DATATYPE_NULL) MPI_Type_free(&int_type);
+  if (root_reals) free(root_reals);
+  if (root_ints) free(root_ints);
+  if (leaf_reals) free(leaf_reals);
+  if (leaf_ints) free(leaf_ints);
+  if (cells) free(cells);
+  if (result.err_code) destroy_fv_geometry(migrated);
+  return result;
+}
+
+// Migrates a partition of the given column mesh to the mesh distributed from
+// it with the given point migration SF, renumbering its cells by their global
+// numbers in the distributed mesh (the order in which DMView writes them). The
+// migrated partition stays on the rank that held the serial cells, and is
+// empty elsewhere, so that it's written only once.
+static tdm_result_t migrate_partition(DM               column_mesh,
+                                      tdm_partition_t *partition,
+                                      PetscSF          migration_sf,
+                                      DM               distributed_mesh,
+                                      tdm_partition_t *migrated) {
+  tdm_result_t result = {};
+  *migrated = (tdm_partition_t){0};
+  PetscInt *root_ints = NULL, *leaf_ints = NULL, *global_numbers = NULL;
+  migrated_cell_t *owned = NULL, *all_owned = NULL;
+  int *counts = NULL, *displs = NULL;
+  IS numbering_is = NULL;
+  const PetscInt *numbering = NULL;
+  MPI_Datatype cell_type = MPI_DATATYPE_NULL;
+
+  MPI_Comm comm;
+  PETSC_CHECK(PetscObjectGetComm((PetscObject)column_mesh, &comm));
+  int num_procs;
+  MPI_Comm_size(comm, &num_procs);
+
+  // Send the serial index of each of our cells (the roots of the SF) to the
+  // distributed mesh's points (the leaves).
+  PetscInt num_roots, c_start, c_end, p_start, p_end;
+  PETSC_CHECK(PetscSFGetGraph(migration_sf, &num_roots, NULL, NULL, NULL));
+  PETSC_CHECK(DMPlexGetHeightStratum(column_mesh, 0, &c_start, &c_end));
+  root_ints = malloc(sizeof(PetscInt) * (num_roots + 1));
+  for (PetscInt i = 0; i < num_roots; ++i) root_ints[i] = -1;
+  for (PetscInt c = c_start; c < c_end; ++c) root_ints[c] = c - c_start;
+  PETSC_CHECK(DMPlexGetChart(distributed_mesh, &p_start, &p_end));
+  leaf_ints = malloc(sizeof(PetscInt) * (p_end + 1));
+  PETSC_CHECK(PetscSFBcastBegin(migration_sf, MPIU_INT, root_ints, leaf_ints,
+                                MPI_REPLACE));
+  PETSC_CHECK(PetscSFBcastEnd(migration_sf, MPIU_INT, root_ints, leaf_ints,
+                              MPI_REPLACE));
+
+  // Gather the serial index and global number of every owned cell on every
+  // rank.
+  PETSC_CHECK(DMPlexGetHeightStratum(distributed_mesh, 0, &c_start, &c_end));
+  PETSC_CHECK(DMPlexGetCellNumbering(distributed_mesh, &numbering_is));
+  PETSC_CHECK(ISGetIndices(numbering_is, &numbering));
+  int num_owned = 0;
+  owned = malloc(sizeof(migrated_cell_t) * (c_end - c_start + 1));
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt number = numbering[c - c_start];
+    if (number < 0) continue;
+    owned[num_owned++] = (migrated_cell_t){
+      .serial_index = leaf_ints[c], .global_number = number
+    };
+  }
+  counts = malloc(sizeof(int) * num_procs);
+  displs = malloc(sizeof(int) * num_procs);
+  MPI_Allgather(&num_owned, 1, MPI_INT, counts, 1, MPI_INT, comm);
+  int num_cells = 0;
+  for (int r = 0; r < num_procs; ++r) {
+    displs[r] = num_cells;
+    num_cells += counts[r];
+  }
+  all_owned = malloc(sizeof(migrated_cell_t) * (num_cells + 1));
+  MPI_Type_contiguous(2, MPIU_INT, &cell_type);
+  MPI_Type_commit(&cell_type);
+  MPI_Allgatherv(owned, num_owned, cell_type, all_owned, counts, displs,
+                 cell_type, comm);
+
+  // Map the partition's serial cell indices to global numbers.
+  PetscInt n = partition->num_cells;
+  global_numbers = malloc(sizeof(PetscInt) * (n + 1));
+  for (PetscInt c = 0; c < n; ++c) global_numbers[c] = -1;
+  for (int i = 0; i < num_cells; ++i) {
+    PetscInt c = all_owned[i].serial_index;
+    if ((c >= 0) && (c < n)) global_numbers[c] = all_owned[i].global_number;
+  }
+  for (PetscInt c = 0; c < n; ++c) {
+    if (global_numbers[c] < 0) {
+      result = tdm_result(1, "Cell %" PetscInt_FMT " of the partitioned mesh "
+                          "is missing from the distributed mesh!", c);
+      goto finished;
+    }
+  }
+
+  // Renumber the partition, keeping the cells owned by and ghosted to each
+  // rank in increasing order.
+  int R = partition->num_ranks;
+  PetscInt num_ghosts = partition->ghost_offsets[R];
+  migrated->num_ranks     = R;
+  migrated->num_cells     = n;
+  migrated->cell_owners   = malloc(sizeof(PetscInt) * (n + 1));
+  migrated->owned_offsets = malloc(sizeof(PetscInt) * (R + 1));
+  migrated->owned_cells   = malloc(sizeof(PetscInt) * (n + 1));
+  migrated->ghost_offsets = malloc(sizeof(PetscInt) * (R + 1));
+  migrated->ghost_cells   = malloc(sizeof(PetscInt) * (num_ghosts + 1));
+  migrated->ghost_owners  = malloc(sizeof(PetscInt) * (num_ghosts + 1));
+  memcpy(migrated->owned_offsets, partition->owned_offsets,
+         sizeof(PetscInt) * (R + 1));
+  memcpy(migrated->ghost_offsets, partition->ghost_offsets,
+         sizeof(PetscInt) * (R + 1));
+  for (PetscInt c = 0; c < n; ++c) {
+    migrated->cell_owners[global_numbers[c]] = partition->cell_owners[c];
+    migrated->owned_cells[c] = global_numbers[partition->owned_cells[c]];
+  }
+  for (PetscInt i = 0; i < num_ghosts; ++i) {
+    migrated->ghost_cells[i] = global_numbers[partition->ghost_cells[i]];
+  }
+  for (int r = 0; r < R; ++r) {
+    PetscInt offset = migrated->owned_offsets[r];
+    PETSC_CHECK(PetscSortInt(migrated->owned_offsets[r+1] - offset,
+                             &migrated->owned_cells[offset]));
+    offset = migrated->ghost_offsets[r];
+    PETSC_CHECK(PetscSortInt(migrated->ghost_offsets[r+1] - offset,
+                             &migrated->ghost_cells[offset]));
+  }
+  for (PetscInt i = 0; i < num_ghosts; ++i) {
+    migrated->ghost_owners[i] = migrated->cell_owners[migrated->ghost_cells[i]];
+  }
+
+finished:
+  if (numbering) ISRestoreIndices(numbering_is, &numbering);
+  if (cell_type != MPI_DATATYPE_NULL) MPI_Type_free(&cell_type);
+  if (root_ints) free(root_ints);
+  if (leaf_ints) free(leaf_ints);
+  if (global_numbers) free(global_numbers);
+  if (owned) free(owned);
+  if (all_owned) free(all_owned);
+  if (counts) free(counts);
+  if (displs) free(displs);
+  if (result.err_code) destroy_partition(migrated);
+  return result;
+}
+
+tdm_result_t distribute_column_mesh(tdm_config_t config,
+                                    size_t       num_points,
+                                    point_t      points[num_points],
+                                    DM           surface_mesh,
+                                    DM           column_mesh,
+                                    DM          *distributed_mesh) {
+  tdm_result_t result = {};
+  *distributed_mesh = NULL;
+  PetscInt *part_sizes = NULL, *part_offsets = NULL, *part_points = NULL;
+  column_partition_t columns = {0};
+  PetscSF migration_sf = NULL;
+
+  MPI_Comm comm;
+  PETSC_CHECK(PetscObjectGetComm((PetscObject)column_mesh, &comm));
+  int nparts;
+  MPI_Comm_size(comm, &nparts);
+  if (nparts == 1) return result;
+
+  result = partition_columns(config, num_points, points, surface_mesh, nparts,
+                             &columns);
+  if (result.err_code) goto finished;
+
+  // Project the column partition onto the prisms, listing the cells for each
+  // rank contiguously, and hand it to a shell partitioner.
+  PetscInt L = config.num_layers, c_start, c_end;
+  PETSC_CHECK(DMPlexGetHeightStratum(column_mesh, 0, &c_start, &c_end));
+  part_sizes = calloc(nparts, sizeof(PetscInt));
+  part_offsets = malloc(sizeof(PetscInt) * nparts);
+  part_points = malloc(sizeof(PetscInt) * (c_end - c_start + 1));
+  for (PetscInt t = 0; t < columns.num_columns; ++t) {
+    part_sizes[columns.column_owners[t]] += L;
+  }
+  PetscInt offset = 0;
+  for (int r = 0; r < nparts; ++r) {
+    part_offsets[r] = offset;
+    offset += part_sizes[r];
+  }
+  for (PetscInt t = 0; t < columns.num_columns; ++t) {
+    PetscInt r = columns.column_owners[t];
+    for (PetscInt k = 0; k < L; ++k) {
+      part_points[part_offsets[r]++] = c_start + t*L + k;
+    }
+  }
+  PetscPartitioner partitioner;
+  PETSC_CHECK(DMPlexGetPartitioner(column_mesh, &partitioner));
+  PETSC_CHECK(PetscPartitionerSetType(partitioner, PETSCPARTITIONERSHELL));
+  PETSC_CHECK(PetscPartitionerShellSetPartition(partitioner, nparts,
+                                                part_sizes, part_points));
+
+  // Distribute the mesh with a one-cell overlap of face neighbors (the
+  // finite-volume adjacency used by build_partition).
+  PETSC_CHECK(DMSetBasicAdjacency(column_mesh, PETSC_TRUE, PETSC_FALSE));
+  PETSC_CHECK(DMPlexDistribute(column_mesh, 1, &migration_sf,
+                               distributed_mesh));
+
+  // Migrate any finite-volume geometry to the distributed cells.
+  tdm_fv_geometry_t *geometry;
+  result = get_attached_data(column_mesh, TDM_FV_GEOMETRY, (void**)&geometry);
+  if (result.err_code) goto finished;
+  if (geometry) {
+    tdm_fv_geometry_t *migrated = malloc(sizeof(tdm_fv_geometry_t));
+    result = migrate_fv_geometry(column_mesh, geometry, migration_sf,
+                                 *distributed_mesh, migrated);
+    if (result.err_code) {
+      free(migrated);
+      goto finished;
+    }
+    result = attach_data(*distributed_mesh, TDM_FV_GEOMETRY, migrated,
+                         destroy_attached_fv_geometry);
+    if (result.err_code) {
+      destroy_attached_fv_geometry(migrated);
+      goto finished;
+    }
+  }
+
+  // Renumber any partition for config.num_ranks to match the distributed
+  // mesh, which is the one that gets written.
+  tdm_partition_t *partition;
+  result = get_attached_data(column_mesh, TDM_PARTITION, (void**)&partition);
+  if (result.err_code) goto finished;
+  if (partition) {
+    tdm_partition_t *migrated = malloc(sizeof(tdm_partition_t));
+    result = migrate_partition(column_mesh, partition, migration_sf,
+                               *distributed_mesh, migrated);
+    if (result.err_code) {
+      free(migrated);
+      goto finished;
+    }
+    result = attach_data(*distributed_mesh, TDM_PARTITION, migrated,
+                         destroy_attached_partition);
+    if (result.err_code) {
+      destroy_attached_partition(migrated);
+      goto finished;
+    }
+  }
+
+  // partition_column_mesh reports on the partition for config.num_ranks
+  // instead, if there is one.
+  if (config.compare_partitions && (config.num_ranks <= 0)) {
+    result = report_partition_quality(config, column_mesh, nparts, &columns);
+  }
+
+finished:
+  destroy_column_partition(&columns);
+  if (migration_sf) PetscSFDestroy(&migration_sf);
+  if (part_sizes) free(part_sizes);
+  if (part_offsets) free(part_offsets);
+  if (part_points) free(part_points);
+  if (result.err_code && *distributed_mesh) DMDestroy(distributed_mesh);
+  return result;
+}
+
+tdm_result_t get_column_mesh_fv_geometry(DM                  column_mesh,
+                                         tdm_fv_geometry_t **geometry) {
+  return get_attached_data(column_mesh, TDM_FV_GEOMETRY, (void**)geometry);
+}
+
+tdm_result_t get_column_mesh_partition(DM                column_mesh,
+                                       tdm_partition_t **partition) {
+  return get_attached_data(column_mesh, TDM_PARTITION, (void**)partition);
+}
+
+void destroy_partition(tdm_partition_t *partition) {
+  if (partition->cell_owners) free(partition->cell_owners);
+  if (partition->owned_offsets) free(partition->owned_offsets);
+  if (partition->owned_cells) free(partition->owned_cells);
+  if (partition->ghost_offsets) free(partition->ghost_offsets);
+  if (partition->ghost_cells) free(partition->ghost_cells);
+  if (partition->ghost_owners) free(partition->ghost_owners);
+  *partition = (tdm_partition_t){0};
+}
+
+// A growable list of indices.
+typedef struct index_list_t {
+  PetscInt *data;
+  PetscInt  size, capacity;
+} index_list_t;
+
+static void append_index(index_list_t *list, PetscInt index) {
+  if (list->size == list->capacity) {
+    list->capacity = (list->capacity) ? 2 * list->capacity : 8;
+    list->data = realloc(list->data, sizeof(PetscInt) * list->capacity);
+  }
+  list->data[list->size++] = index;
+}
+
+// Removes the first occurrence of the given index from the list (without
+// preserving order).
+static void remove_index(index_list_t *list, PetscInt index) {
+  for (PetscInt i = 0; i < list->size; ++i) {
+    if (list->data[i] == index) {
+      list->data[i] = list->data[--list->size];
+      return;
+    }
+  }
+}
+
+static bool contains_index(const index_list_t *list, PetscInt index) {
+  for (PetscInt i = 0; i < list->size; ++i) {
+    if (list->data[i] == index) return true;
+  }
+  return false;
+}
+
+static void free_index_list(index_list_t *list) {
+  if (list->data) free(list->data);
+  *list = (index_list_t){0};
+}
+
+// This type holds the state of a surface mesh being decimated.
+typedef struct decimation_t {
+  PetscReal max_error;     // maximum vertical deviation from samples
+  PetscReal min_cos_angle; // cosine of the minimum triangle angle
+
+  // vertices: coordinates, quadrics, flags, incident triangles
+  PetscInt      num_vertices;
+  PetscReal    *x;         // [3*num_vertices]
+  PetscReal    *quadrics;  // [10*num_vertices], symmetric 4x4 matrices
+  bool         *boundary;  // [num_vertices]
+  bool         *removed;   // [num_vertices]
+  int          *locks;     // [num_vertices] round in which a vertex is locked
+  index_list_t *vertex_tris;
+
+  // triangles: vertices, flags, samples lying within them
+  PetscInt      num_tris;
+  PetscInt     *tris;      // [3*num_tris]
+  bool         *dead;      // [num_tris]
+  index_list_t *tri_samples;
+
+  // sample points from the DEM (and the original mesh vertices)
+  size_t   num_samples;
+  point_t *samples;
+} decimation_t;
+
+// Computes the barycentric coordinates of (x, y) with respect to the given
+// triangle projected onto the x-y plane, returning true if the point lies
+// within the triangle.
+static bool get_barycentric_coords(const PetscReal a[3],
+                                   const PetscReal b[3],
+                                   const PetscReal c[3],
+                                   PetscReal x, PetscReal y,
+                                   PetscReal l[3]) {
+  PetscReal det = (b[1] - c[1]) * (a[0] - c[0]) + (c[0] - b[0]) * (a[1] - c[1]);
+  if (fabs(det) < 1e-300) return false;
+  l[0] = ((b[1] - c[1]) * (x - c[0]) + (c[0] - b[0]) * (y - c[1])) / det;
+  l[1] = ((c[1] - a[1]) * (x - c[0]) + (a[0] - c[0]) * (y - c[1])) / det;
+  l[2] = 1.0 - l[0] - l[1];
+  const PetscReal tol = -1e-10;
+  return (l[0] >= tol) && (l[1] >= tol) && (l[2] >= tol);
+}
+
+// Returns twice the signed area of the given triangle projected onto the x-y
+// plane.
+static PetscReal xy_area2(const PetscReal a[3],
+                          const PetscReal b[3],
+                          const PetscReal c[3]) {
+  return (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+}
+
+// Returns the cosine of the smallest angle in the given triangle (the largest
+// cosine among its angles).
+static PetscReal max_cos_angle(const PetscReal a[3],
+                               const PetscReal b[3],
+                               const PetscReal c[3]) {
+  const PetscReal *v[3] = {a, b, c};
+  PetscReal max_cos = -1.0;
+  for (int i = 0; i < 3; ++i) {
+    const PetscReal *p = v[i], *q = v[(i+1)%3], *r = v[(i+2)%3];
+    PetscReal e1[3], e2[3], dot = 0.0, l1 = 0.0, l2 = 0.0;
+    for (int d = 0; d < 3; ++d) {
+      e1[d] = q[d] - p[d];
+      e2[d] = r[d] - p[d];
+      dot += e1[d] * e2[d];
+      l1 += e1[d] * e1[d];
+      l2 += e2[d] * e2[d];
+    }
+    PetscReal cos_angle = (l1 > 0.0 && l2 > 0.0) ? dot / sqrt(l1 * l2) : 1.0;
+    if (max_cos < cos_angle) max_cos = cos_angle;
+  }
+  return max_cos;
+}
+
+// Adds the area-weighted quadric of the plane of the given triangle to the
+// given quadric.
+static void add_plane_quadric(const PetscReal a[3],
+                              const PetscReal b[3],
+                              const PetscReal c[3],
+                              PetscReal       Q[10]) {
+  PetscReal e1[3], e2[3], n[3];
+  for (int d = 0; d < 3; ++d) {
+    e1[d] = b[d] - a[d];
+    e2[d] = c[d] - a[d];
+  }
+  n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+  n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+  n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+  PetscReal n_mag = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+  if (n_mag == 0.0) return;
+  PetscReal area = 0.5 * n_mag;
+  for (int d = 0; d < 3; ++d) n[d] /= n_mag;
+  PetscReal p[4] = {n[0], n[1], n[2], -(n[0]*a[0] + n[1]*a[1] + n[2]*a[2])};
+  int k = 0;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i; j < 4; ++j) {
+      Q[k++] += area * p[i] * p[j];
+    }
+  }
+}
+
+// Evaluates the sum of two quadrics at the given position.
+static PetscReal eval_quadrics(const PetscReal Q1[10],
+                               const PetscReal Q2[10],
+                               const PetscReal x[3]) {
+  PetscReal v[4] = {x[0], x[1], x[2], 1.0}, sum = 0.0;
+  int k = 0;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i; j < 4; ++j) {
+      PetscReal q = Q1[k] + Q2[k];
+      sum += ((i == j) ? 1.0 : 2.0) * q * v[i] * v[j];
+      ++k;
+    }
+  }
+  return sum;
+}
+
+// Returns the vertical deviation of the given sample from the given triangle
+// if the sample lies within the triangle, or a negative number if not.
+static PetscReal sample_deviation(const decimation_t *dec,
+                                  const PetscInt      tri[3],
+                                  const point_t      *sample) {
+  const PetscReal *a = &dec->x[3*tri[0]], *b = &dec->x[3*tri[1]],
+                  *c = &dec->x[3*tri[2]];
+  PetscReal l[3];
+  if (!get_barycentric_coords(a, b, c, sample->x, sample->y, l)) return -1.0;
+  return fabs(sample->z - (l[0] * a[2] + l[1] * b[2] + l[2] * c[2]));
+}
+
+// Gathers the vertices adjacent to vertex v.
+static void get_vertex_ring(const decimation_t *dec,
+                            PetscInt            v,
+                            index_list_t       *ring) {
+  ring->size = 0;
+  const index_list_t *star = &dec->vertex_tris[v];
+  for (PetscInt i = 0; i < star->size; ++i) {
+    const PetscInt *tri = &dec->tris[3*star->data[i]];
+    for (int j = 0; j < 3; ++j) {
+      if ((tri[j] != v) && !contains_index(ring, tri[j])) {
+        append_index(ring, tri[j]);
+      }
+    }
+  }
+}
+
+// Attempts to collapse the edge between v and u by moving v onto u, returning
+// true if the collapse keeps the mesh valid and within the error and angle
+// limits, and false (leaving the mesh untouched) if not. Only the triangles
+// around v and the vertices adjacent to v are modified.
+static bool collapse_edge(decimation_t *dec, PetscInt v, PetscInt u) {
+  index_list_t *star = &dec->vertex_tris[v];
+
+  // The edge must be shared by exactly two triangles, and the vertices
+  // opposite it must be the only ones adjacent to both v and u.
+  PetscInt shared[2], opposite[2], num_shared = 0;
+  for (PetscInt i = 0; i < star->size; ++i) {
+    const PetscInt *tri = &dec->tris[3*star->data[i]];
+    if ((tri[0] == u) || (tri[1] == u) || (tri[2] == u)) {
+      if (num_shared == 2) return false;
+      shared[num_shared] = star->data[i];
+      for (int j = 0; j < 3; ++j) {
+        if ((tri[j] != u) && (tri[j] != v)) opposite[num_shared] = tri[j];
+      }
+      ++num_shared;
+    }
+  }
+  if (num_shared != 2) return false;
+  index_list_t v_ring = {0}, u_ring = {0};
+  get_vertex_ring(dec, v, &v_ring);
+  get_vertex_ring(dec, u, &u_ring);
+  bool valid = true;
+  for (PetscInt i = 0; (i < v_ring.size) && valid; ++i) {
+    PetscInt w = v_ring.data[i];
+    if ((w != u) && (w != opposite[0]) && (w != opposite[1]) &&
+        contains_index(&u_ring, w)) {
+      valid = false;
+    }
+  }
+  free_index_list(&v_ring);
+  free_index_list(&u_ring);
+  if (!valid) return false;
+
+  // The surviving triangles, with v replaced by u, must keep their
+  // orientation and satisfy the angle limit.
+  PetscInt num_new = 0;
+  PetscInt *new_tris = malloc(sizeof(PetscInt) * 3 * star->size);
+  PetscInt *new_ids = malloc(sizeof(PetscInt) * star->size);
+  for (PetscInt i = 0; (i < star->size) && valid; ++i) {
+    PetscInt t = star->data[i];
+    if ((t == shared[0]) || (t == shared[1])) continue;
+    PetscInt *tri = &new_tris[3*num_new];
+    for (int j = 0; j < 3; ++j) {
+      tri[j] = (dec->tris[3*t+j] == v) ? u : dec->tris[3*t+j];
+    }
+    const PetscReal *a = &dec->x[3*tri[0]], *b = &dec->x[3*tri[1]],
+                    *c = &dec->x[3*tri[2]];
+    PetscReal old_area2 = xy_area2(&dec->x[3*dec->tris[3*t]],
+                                   &dec->x[3*dec->tris[3*t+1]],
+                                   &dec->x[3*dec->tris[3*t+2]]);
+    PetscReal new_area2 = xy_area2(a, b, c);
+    if ((new_area2 * old_area2 <= 0.0) ||
+        (max_cos_angle(a, b, c) > dec->min_cos_angle)) {
+      valid = false;
+    }
+    new_ids[num_new++] = t;
+  }
+
+  // Every sample in the old triangles must lie within a new triangle, within
+  // the error limit.
+  PetscInt num_moved = 0;
+  for (PetscInt i = 0; i < star->size; ++i) {
+    num_moved += dec->tri_samples[star->data[i]].size;
+  }
+  PetscInt *moved = malloc(sizeof(PetscInt) * 2 * (num_moved + 1));
+  num_moved = 0;
+  for (PetscInt i = 0; (i < star->size) && valid; ++i) {
+    const index_list_t *samples = &dec->tri_samples[star->data[i]];
+    for (PetscInt k = 0; (k < samples->size) && valid; ++k) {
+      const point_t *sample = &dec->samples[samples->data[k]];
+      PetscInt home = -1;
+      for (PetscInt n = 0; n < num_new; ++n) {
+        PetscReal dev = sample_deviation(dec, &new_tris[3*n], sample);
+        if (dev >= 0.0) {
+          if (dev > dec->max_error) valid = false;
+          home = n;
+          break;
+        }
+      }
+      if (home == -1) valid = false;
+      moved[2*num_moved] = samples->data[k];
+      moved[2*num_moved+1] = home;
+      ++num_moved;
+    }
+  }
+
+  if (valid) {
+    // Remove the triangles sharing the edge.
+    for (int s = 0; s < 2; ++s) {
+      PetscInt t = shared[s];
+      dec->dead[t] = true;
+      remove_index(&dec->vertex_tris[u], t);
+      remove_index(&dec->vertex_tris[opposite[s]], t);
+      dec->tri_samples[t].size = 0;
+    }
+
+    // Move the rest onto u.
+    for (PetscInt n = 0; n < num_new; ++n) {
+      PetscInt t = new_ids[n];
+      for (int j = 0; j < 3; ++j) dec->tris[3*t+j] = new_tris[3*n+j];
+      append_index(&dec->vertex_tris[u], t);
+      dec->tri_samples[t].size = 0;
+    }
+    for (PetscInt i = 0; i < num_moved; ++i) {
+      append_index(&dec->tri_samples[new_ids[moved[2*i+1]]], moved[2*i]);
+    }
+
+    for (int k = 0; k < 10; ++k) {
+      dec->quadrics[10*u+k] += dec->quadrics[10*v+k];
+    }
+    dec->removed[v] = true;
+    star->size = 0;
+  }
+
+  free(new_tris);
+  free(new_ids);
+  free(moved);
+  return valid;
+}
+
+// Attempts to remove vertex v by collapsing it onto one of its neighbors, in
+// order of increasing quadric error, returning true on success.
+static bool remove_vertex(decimation_t *dec, PetscInt v) {
+  index_list_t ring = {0};
+  get_vertex_ring(dec, v, &ring);
+  PetscReal *costs = malloc(sizeof(PetscReal) * (ring.size + 1));
+  for (PetscInt i = 0; i < ring.size; ++i) {
+    PetscInt u = ring.data[i];
+    costs[i] = eval_quadrics(&dec->quadrics[10*v], &dec->quadrics[10*u],
+                             &dec->x[3*u]);
+  }
+  bool removed = false;
+  for (PetscInt n = 0; (n < ring.size) && !removed; ++n) {
+    PetscInt best = n; // selection sort--rings are small
+    for (PetscInt i = n + 1; i < ring.size; ++i) {
+      if (costs[i] < costs[best]) best = i;
+    }
+    PetscInt u = ring.data[best];
+    PetscReal cost = costs[best];
+    ring.data[best] = ring.data[n];
+    costs[best] = costs[n];
+    ring.data[n] = u;
+    costs[n] = cost;
+    removed = collapse_edge(dec, v, u);
+  }
+  free(costs);
+  free_index_list(&ring);
+  return removed;
+}
+
+// A candidate vertex for removal and the cost of its cheapest collapse.
+typedef struct removal_t {
+  PetscInt  vertex;
+  PetscReal cost;
+} removal_t;
+
+static int compare_removals(const void *a, const void *b) {
+  const removal_t *ra = a, *rb = b;
+  return (ra->cost < rb->cost) ? -1 : (ra->cost > rb->cost) ? 1 : 0;
+}
+
+// This type describes work for a decimation thread: a batch of independent
+// vertices, every num_threads-th of which it attempts to remove.
+typedef struct decimation_work_t {
+  decimation_t   *dec;
+  const PetscInt *batch;
+  PetscInt        batch_size;
+  int             thread, num_threads;
+  PetscInt        num_removed;
+} decimation_work_t;
+
+static void *remove_vertices(void *context) {
+  decimation_work_t *work = context;
+  for (PetscInt i = work->thread; i < work->batch_size; i += work->num_threads) {
+    if (remove_vertex(work->dec, work->batch[i])) ++work->num_removed;
+  }
+  return NULL;
+}
+
+// Performs one round of decimation: selects an independent set of vertices
+// (no two of which share a triangle) in order of increasing collapse cost and
+// tries to remove them in parallel, returning the number removed.
+static PetscInt decimate_round(decimation_t *dec, int round, int num_threads) {
+  // Rank the removable vertices by the cost of their cheapest collapse.
+  removal_t *candidates = malloc(sizeof(removal_t) * (dec->num_vertices + 1));
+  PetscInt num_candidates = 0;
+  index_list_t ring = {0};
+  for (PetscInt v = 0; v < dec->num_vertices; ++v) {
+    if (dec->removed[v] || dec->boundary[v]) continue;
+    get_vertex_ring(dec, v, &ring);
+    PetscReal min_cost = PETSC_MAX_REAL;
+    for (PetscInt i = 0; i < ring.size; ++i) {
+      PetscInt u = ring.data[i];
+      PetscReal cost = eval_quadrics(&dec->quadrics[10*v],
+                                     &dec->quadrics[10*u], &dec->x[3*u]);
+      if (min_cost > cost) min_cost = cost;
+    }
+    if (ring.size > 0) {
+      candidates[num_candidates++] = (removal_t){v, min_cost};
+    }
+  }
+  qsort(candidates, num_candidates, sizeof(removal_t), compare_removals);
+
+  // Select an independent set, locking each selected vertex and its ring so
+  // that the triangles changed by its removal can't be touched by others.
+  PetscInt *batch = malloc(sizeof(PetscInt) * (num_candidates + 1));
+  PetscInt batch_size = 0;
+  for (PetscInt c = 0; c < num_candidates; ++c) {
+    PetscInt v = candidates[c].vertex;
+    if (dec->locks[v] == round) continue;
+    get_vertex_ring(dec, v, &ring);
+    bool free_ring = true;
+    for (PetscInt i = 0; (i < ring.size) && free_ring; ++i) {
+      if (dec->locks[ring.data[i]] == round) free_ring = false;
+    }
+    if (!free_ring) continue;
+    dec->locks[v] = round;
+    for (PetscInt i = 0; i < ring.size; ++i) dec->locks[ring.data[i]] = round;
+    batch[batch_size++] = v;
+  }
+  free_index_list(&ring);
+  free(candidates);
+
+  // Remove the selected vertices in parallel.
+  if (num_threads > batch_size) num_threads = (batch_size > 0) ? batch_size : 1;
+  pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+  decimation_work_t *work = malloc(sizeof(decimation_work_t) * num_threads);
+  for (int t = 0; t < num_threads; ++t) {
+    work[t] = (decimation_work_t){
+      .dec = dec, .batch = batch, .batch_size = batch_size,
+      .thread = t, .num_threads = num_threads
+    };
+  }
+  for (int t = 1; t < num_threads; ++t) {
+    if (pthread_create(&threads[t], NULL, remove_vertices, &work[t])) {
+      remove_vertices(&work[t]); // do it ourselves
+      threads[t] = pthread_self();
+    }
+  }
+  remove_vertices(&work[0]);
+  PetscInt num_removed = work[0].num_removed;
+  for (int t = 1; t < num_threads; ++t) {
+    if (!pthread_equal(threads[t], pthread_self())) {
+      pthread_join(threads[t], NULL);
+    }
+    num_removed += work[t].num_removed;
+  }
+  free(threads);
+  free(work);
+  free(batch);
+  return num_removed;
+}
+
+// Returns the number of threads each rank should use for decimation: the value
+// of OMP_NUM_THREADS if it's set, or else the node's processors divided evenly
+// among the ranks in the given communicator that share the node.
+static int get_num_threads(MPI_Comm comm) {
+  const char *omp_num_threads = getenv("OMP_NUM_THREADS");
+  if (omp_num_threads && (atoi(omp_num_threads) > 0)) {
+    return atoi(omp_num_threads);
+  }
+  long num_procs = sysconf(_SC_NPROCESSORS_ONLN);
+  int node_size = 1;
+  MPI_Comm node_comm;
+  if (MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+                          &node_comm) == MPI_SUCCESS) {
+    MPI_Comm_size(node_comm, &node_size);
+    MPI_Comm_free(&node_comm);
+  }
+  long num_threads = (num_procs > 0) ? num_procs / node_size : 1;
+  return (num_threads > 0) ? (int)num_threads : 1;
+}
+
+static void destroy_decimation(decimation_t *dec) {
+  if (dec->vertex_tris) {
+    for (PetscInt v = 0; v < dec->num_vertices; ++v) {
+      free_index_list(&dec->vertex_tris[v]);
+    }
+  }
+  if (dec->tri_samples) {
+    for (PetscInt t = 0; t < dec->num_tris; ++t) {
+      free_index_list(&dec->tri_samples[t]);
+    }
+  }
+  free(dec->x);
+  free(dec->quadrics);
+  free(dec->boundary);
+  free(dec->removed);
+  free(dec->locks);
+  free(dec->vertex_tris);
+  free(dec->tris);
+  free(dec->dead);
+  free(dec->tri_samples);
+  free(dec->samples);
+  *dec = (decimation_t){0};
+}
+
+// Initializes the decimation of the given triangles, computing vertex
+// quadrics and boundary flags and assigning the given sample points to the
+// triangles that contain them.
+static void init_decimation(decimation_t *dec,
+                            size_t        num_points,
+                            point_t       points[num_points]) {
+  PetscInt nv = dec->num_vertices, nt = dec->num_tris;
+  dec->quadrics = calloc(10 * nv + 1, sizeof(PetscReal));
+  dec->boundary = calloc(nv + 1, sizeof(bool));
+  dec->removed = calloc(nv + 1, sizeof(bool));
+  dec->locks = calloc(nv + 1, sizeof(int));
+  dec->vertex_tris = calloc(nv + 1, sizeof(index_list_t));
+  dec->dead = calloc(nt + 1, sizeof(bool));
+  dec->tri_samples = calloc(nt + 1, sizeof(index_list_t));
+
+  for (PetscInt t = 0; t < nt; ++t) {
+    const PetscInt *tri = &dec->tris[3*t];
+    for (int j = 0; j < 3; ++j) {
+      append_index(&dec->vertex_tris[tri[j]], t);
+      add_plane_quadric(&dec->x[3*tri[0]], &dec->x[3*tri[1]],
+                        &dec->x[3*tri[2]], &dec->quadrics[10*tri[j]]);
+    }
+  }
+
+  // A vertex is on the boundary if one of its edges belongs to only one
+  // triangle.
+  index_list_t ring = {0};
+  for (PetscInt v = 0; v < nv; ++v) {
+    get_vertex_ring(dec, v, &ring);
+    const index_list_t *star = &dec->vertex_tris[v];
+    for (PetscInt i = 0; (i < ring.size) && !dec->boundary[v]; ++i) {
+      int count = 0;
+      for (PetscInt k = 0; k < star->size; ++k) {
+        const PetscInt *tri = &dec->tris[3*star->data[k]];
+        if ((tri[0] == ring.data[i]) || (tri[1] == ring.data[i]) ||
+            (tri[2] == ring.data[i])) {
+          ++count;
+        }
+      }
+      if (count != 2) dec->boundary[v] = true;
+    }
+  }
+  free_index_list(&ring);
+
+  // The samples are the masked DEM points and the original mesh vertices.
+  dec->samples = malloc(sizeof(point_t) * (num_points + nv + 1));
+  dec->num_samples = 0;
+  for (size_t p = 0; p < num_points; ++p) {
+    if (points[p].mask) dec->samples[dec->num_samples++] = points[p];
+  }
+  for (PetscInt v = 0; v < nv; ++v) {
+    dec->samples[dec->num_samples++] = (point_t){
+      .x = dec->x[3*v], .y = dec->x[3*v+1], .z = dec->x[3*v+2], .mask = 1
+    };
+  }
+
+  // Assign each sample to the first triangle containing it.
+  tdm_point_grid_t grid;
+  tdm_point_grid_build(dec->num_samples, dec->samples, &grid);
+  bool *assigned = calloc(dec->num_samples + 1, sizeof(bool));
+  for (PetscInt t = 0; t < nt; ++t) {
+    const PetscInt *tri = &dec->tris[3*t];
+    PetscReal min_x = PETSC_MAX_REAL, max_x = -PETSC_MAX_REAL,
+              min_y = PETSC_MAX_REAL, max_y = -PETSC_MAX_REAL;
+    for (int j = 0; j < 3; ++j) {
+      const PetscReal *x = &dec->x[3*tri[j]];
+      if (min_x > x[0]) min_x = x[0];
+      if (max_x < x[0]) max_x = x[0];
+      if (min_y > x[1]) min_y = x[1];
+      if (max_y < x[1]) max_y = x[1];
+    }
+    size_t i0, j0, i1, j1;
+    tdm_point_grid_bucket(&grid, min_x, min_y, &i0, &j0);
+    tdm_point_grid_bucket(&grid, max_x, max_y, &i1, &j1);
+    for (size_t j = j0; j <= j1; ++j) {
+      for (size_t i = i0; i <= i1; ++i) {
+        size_t b = j * grid.nx + i;
+        for (size_t k = grid.offsets[b]; k < grid.offsets[b+1]; ++k) {
+          size_t s = grid.indices[k];
+          if (!assigned[s] &&
+              (sample_deviation(dec, tri, &dec->samples[s]) >= 0.0)) {
+            append_index(&dec->tri_samples[t], (PetscInt)s);
+            assigned[s] = true;
+          }
+        }
+      }
+    }
+  }
+  free(assigned);
+  tdm_point_grid_destroy(&grid);
+}
+
+tdm_result_t decimate_surface_mesh(tdm_config_t config,
+                                   size_t       num_points,
+                                   point_t      points[num_points],
+                                   DM           surface_mesh,
+                                   DM          *decimated_mesh) {
+  tdm_result_t result = {};
+  *decimated_mesh = NULL;
+  decimation_t dec = {
+    .max_error = config.decimation_max_error,
+    .min_cos_angle = cos(config.decimation_min_angle * PETSC_PI / 180.0)
+  };
+  const PetscScalar *coords = NULL;
+  Vec coord_vec = NULL;
+  PetscInt *cells = NULL;
+  PetscReal *vertex_coords = NULL;
+
+  if (config.decimation_max_error <= 0.0) {
+    return tdm_result(1, "Decimation requires a positive max_error!");
+  }
+  PetscInt dim;
+  PETSC_CHECK(DMGetCoordinateDim(surface_mesh, &dim));
+  if (dim != 3) {
+    return tdm_result(1, "Surface mesh has %" PetscInt_FMT "-D coordinates "
+                      "(expected 3-D).", dim);
+  }
+
+  // Extract the vertices and triangles of the surface mesh.
+  PetscInt c_start, c_end, v_start, v_end;
+  PETSC_CHECK(DMPlexGetHeightStratum(surface_mesh, 0, &c_start, &c_end));
+  PETSC_CHECK(DMPlexGetDepthStratum(surface_mesh, 0, &v_start, &v_end));
+  dec.num_vertices = v_end - v_start;
+  dec.num_tris = c_end - c_start;
+  dec.x = malloc(sizeof(PetscReal) * (3 * dec.num_vertices + 1));
+  dec.tris = malloc(sizeof(PetscInt) * (3 * dec.num_tris + 1));
+  PetscSection coord_section;
+  PETSC_CHECK(DMGetCoordinateSection(surface_mesh, &coord_section));
+  PETSC_CHECK(DMGetCoordinatesLocal(surface_mesh, &coord_vec));
+  PETSC_CHECK(VecGetArrayRead(coord_vec, &coords));
+  for (PetscInt v = v_start; v < v_end; ++v) {
+    get_vertex_coords(coord_section, coords, v, &dec.x[3*(v - v_start)]);
+  }
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt closure_size, *closure = NULL, nv = 0;
+    PETSC_CHECK(DMPlexGetTransitiveClosure(surface_mesh, c, PETSC_TRUE,
+                                           &closure_size, &closure));
+    for (PetscInt i = 0; i < closure_size; ++i) {
+      PetscInt p = closure[2*i];
+      if ((p >= v_start) && (p < v_end) && (nv < 3)) {
+        dec.tris[3*(c - c_start) + nv++] = p - v_start;
+      }
+    }
+    PETSC_CHECK(DMPlexRestoreTransitiveClosure(surface_mesh, c, PETSC_TRUE,
+                                               &closure_size, &closure));
+    if (nv != 3) {
+      result = tdm_result(1, "Surface cell %" PetscInt_FMT " is not a "
+                          "triangle!", c);
+      goto finished;
+    }
+  }
+  PETSC_CHECK(VecRestoreArrayRead(coord_vec, &coords));
+  coords = NULL;
+
+  // Decimate in rounds until no more vertices can be removed.
+  MPI_Comm comm;
+  PETSC_CHECK(PetscObjectGetComm((PetscObject)surface_mesh, &comm));
+  init_decimation(&dec, num_points, points);
+  int num_threads = get_num_threads(comm);
+  for (int round = 1; decimate_round(&dec, round, num_threads) > 0; ++round);
+
+  // Measure the deviation we've actually reached.
+  PetscReal max_dev = 0.0;
+  for (PetscInt t = 0; t < dec.num_tris; ++t) {
+    if (dec.dead[t]) continue;
+    const index_list_t *samples = &dec.tri_samples[t];
+    for (PetscInt k = 0; k < samples->size; ++k) {
+      PetscReal dev = sample_deviation(&dec, &dec.tris[3*t],
+                                       &dec.samples[samples->data[k]]);
+      if (max_dev < dev) max_dev = dev;
+    }
+  }
+
+  // Renumber the remaining vertices and triangles and build a new mesh.
+  PetscInt *vertex_ids = malloc(sizeof(PetscInt) * (dec.num_vertices + 1));
+  PetscInt num_vertices = 0, num_tris = 0;
+  vertex_coords = malloc(sizeof(PetscReal) * (3 * dec.num_vertices + 1));
+  for (PetscInt v = 0; v < dec.num_vertices; ++v) {
+    if (dec.removed[v]) continue;
+    vertex_ids[v] = num_vertices;
+    for (int d = 0; d < 3; ++d) {
+      vertex_coords[3*num_vertices+d] = dec.x[3*v+d];
+    }
+    ++num_vertices;
+  }
+  cells = malloc(sizeof(PetscInt) * (3 * dec.num_tris + 1));
+  for (PetscInt t = 0; t < dec.num_tris; ++t) {
+    if (dec.dead[t]) continue;
+    for (int j = 0; j < 3; ++j) {
+      cells[3*num_tris+j] = vertex_ids[dec.tris[3*t+j]];
+    }
+    ++num_tris;
+  }
+  free(vertex_ids);
+
+  PETSC_CHECK(DMPlexCreateFromCellListPetsc(comm, 2, num_tris, num_vertices, 3,
+                                            PETSC_TRUE, cells, 3,
+                                            vertex_coords, decimated_mesh));
+
+  // Report the reduction.
+  long long counts[3] = {dec.num_tris, num_tris, 0};
+  MPI_Allreduce(MPI_IN_PLACE, counts, 2, MPI_LONG_LONG, MPI_SUM, comm);
+  MPI_Allreduce(MPI_IN_PLACE, &max_dev, 1, MPIU_REAL, MPI_MAX, comm);
+  PetscPrintf(comm, "Decimation: %lld -> %lld triangles, %lld -> %lld prisms "
+              "(%.1f%% fewer), max vertical deviation %g m\n",
+              counts[0], counts[1], counts[0] * config.num_layers,
+              counts[1] * config.num_layers,
+              (counts[0] > 0) ? 100.0 * (counts[0] - counts[1]) / counts[0] : 0.0,
+              (double)max_dev);
+
+finished:
+  if (coords) VecRestoreArrayRead(coord_vec, &coords);
+  if (cells) free(cells);
+  if (vertex_coords) free(vertex_coords);
+  destroy_decimation(&dec);
+  return result;
+}
+
+// Writes the given array of reals to a dataset with the given name and block
+// size in the current group of the given HDF5 viewer.
+static tdm_result_t write_real_dataset(PetscViewer      viewer,
+                                       const char      *name,
+                                       PetscInt         block_size,
+                                       PetscInt         num_blocks,
+                                       const PetscReal *data) {
+  tdm_result_t result = {};
+  Vec vec = NULL;
+  PetscScalar *array;
+  PETSC_CHECK(VecCreateMPI(PETSC_COMM_WORLD, block_size * num_blocks,
+                           PETSC_DETERMINE, &vec));
+  PETSC_CHECK(VecSetBlockSize(vec, block_size));
+  PETSC_CHECK(PetscObjectSetName((PetscObject)vec, name));
+  PETSC_CHECK(VecGetArray(vec, &array));
+  for (PetscInt i = 0; i < block_size * num_blocks; ++i) array[i] = data[i];
+  PETSC_CHECK(VecRestoreArray(vec, &array));
+  PETSC_CHECK(VecView(vec, viewer));
+finished:
+  if (vec) VecDestroy(&vec);
+  return result;
+}
+
+// Writes the given array of integers to a dataset with the given name and
+// block size in the current group of the given HDF5 viewer.
+static tdm_result_t write_int_dataset(PetscViewer     viewer,
+                                      const char     *name,
+                                      PetscInt        block_size,
+                                      PetscInt        num_blocks,
+                                      const PetscInt *data) {
+  tdm_result_t result = {};
+  IS is = NULL;
+  PETSC_CHECK(ISCreateGeneral(PETSC_COMM_WORLD, block_size * num_blocks, data,
+                              PETSC_USE_POINTER, &is));
+  PETSC_CHECK(ISSetBlockSize(is, block_size));
+  PETSC_CHECK(PetscObjectSetName((PetscObject)is, name));
+  PETSC_CHECK(ISView(is, viewer));
+finished:
+  if (is) ISDestroy(&is);
+  return result;
+}
+
+// Writes finite-volume geometry to the /fv_geometry group of an HDF5 viewer,
+// which keeps it apart from PETSc's /geometry group in HDF5 mesh files.
+static tdm_result_t write_fv_geometry(PetscViewer        viewer,
+                                      tdm_fv_geometry_t *geometry) {
+  tdm_result_t result = {};
+  PetscInt n = geometry->num_cells;
+  PETSC_CHECK(PetscViewerHDF5PushGroup(viewer, "/fv_geometry"));
+  result = write_real_dataset(viewer, "cell_volumes", 1, n,
+                              geometry->cell_volumes);
+  if (!result.err_code) {
+    result = write_real_dataset(viewer, "cell_centroids", 3, n,
+                                geometry->cell_centroids);
+  }
+  if (!result.err_code) {
+    result = write_real_dataset(viewer, "face_areas", TDM_PRISM_NUM_FACES, n,
+                                geometry->face_areas);
+  }
+  if (!result.err_code) {
+    result = write_real_dataset(viewer, "face_normals", 3,
+                                TDM_PRISM_NUM_FACES * n,
+                                geometry->face_normals);
+  }
+  if (!result.err_code) {
+    result = write_int_dataset(viewer, "cell_neighbors", TDM_PRISM_NUM_FACES, n,
+                               geometry->cell_neighbors);
+  }
+  PETSC_CHECK(PetscViewerHDF5PopGroup(viewer));
+finished:
+  return result;
+}
+
+// Writes a partition to the /partition group of an HDF5 viewer. The owning
+// rank of every cell is written to /partition/cell_owners, and the cells
+// owned by and ghosted to rank r are written to /partition/rank_<r>.
+static tdm_result_t write_partition(PetscViewer      viewer,
+                                    tdm_partition_t *partition) {
+  tdm_result_t result = {};
+  PETSC_CHECK(PetscViewerHDF5PushGroup(viewer, "/partition"));
+  result = write_int_dataset(viewer, "cell_owners", 1, partition->num_cells,
+                             partition->cell_owners);
+  PETSC_CHECK(PetscViewerHDF5PopGroup(viewer));
+  for (int r = 0; (r < partition->num_ranks) && !result.err_code; ++r) {
+    char group[64];
+    snprintf(group, 64, "/partition/rank_%d", r);
+    PetscInt owned_offset = partition->owned_offsets[r],
+             num_owned = partition->owned_offsets[r+1] - owned_offset,
+             ghost_offset = partition->ghost_offsets[r],
+             num_ghosts = partition->ghost_offsets[r+1] - ghost_offset;
+    PETSC_CHECK(PetscViewerHDF5PushGroup(viewer, group));
+    result = write_int_dataset(viewer, "owned_cells", 1, num_owned,
+                               &partition->owned_cells[owned_offset]);
+    if (!result.err_code) {
+      result = write_int_dataset(viewer, "ghost_cells", 1, num_ghosts,
+                                 &partition->ghost_cells[ghost_offset]);
+    }
+    if (!result.err_code) {
+      result = write_int_dataset(viewer, "ghost_owners", 1, num_ghosts,
+                                 &partition->ghost_owners[ghost_offset]);
+    }
+    PETSC_CHECK(PetscViewerHDF5PopGroup(viewer));
+  }
+finished:
+  return result;
+}
+
+tdm_result_t write_mesh(tdm_config_t config, DM mesh, const char *prefix) {
+  tdm_result_t result = {};
+  PetscViewer viewer = NULL;
+
+  // Figure out where the mesh goes.
+  tdm_mesh_format_t format;
+  const char *file_name;
+  if (!strcmp(prefix, "surface_mesh")) {
+    format = config.surface_mesh_format;
+    file_name = config.surface_mesh_file;
+  } else if (!strcmp(prefix, "column_mesh")) {
+    format = config.column_mesh_format;
+    file_name = config.column_mesh_file;
+  } else {
+    return tdm_result(1, "Invalid mesh prefix: %s", prefix);
+  }
+  if (!file_name) return result; // no output requested
+
+  // Write the mesh.
+  if (format == TDM_EXODUS) {
+    PETSC_CHECK(PetscViewerExodusIIOpen(PETSC_COMM_WORLD, file_name,
+                                        FILE_MODE_WRITE, &viewer));
+  } else {
+    PETSC_CHECK(PetscViewerHDF5Open(PETSC_COMM_WORLD, file_name,
+                                    FILE_MODE_WRITE, &viewer));
+  }
+  PETSC_CHECK(DMView(mesh, viewer));
+
+  // Write any attached finite-volume geometry or partitioning next to the
+  // mesh.
+  tdm_fv_geometry_t *geometry;
+  tdm_partition_t *partition;
+  result = get_attached_data(mesh, TDM_FV_GEOMETRY, (void**)&geometry);
+  if (result.err_code) goto finished;
+  result = get_attached_data(mesh, TDM_PARTITION, (void**)&partition);
+  if (result.err_code) goto finished;
+  if ((geometry || partition) && (format == TDM_EXODUS)) {
+    char aux_file_name[PETSC_MAX_PATH_LEN];
+    snprintf(aux_file_name, PETSC_MAX_PATH_LEN, "%s.h5", file_name);
+    PETSC_CHECK(PetscViewerDestroy(&viewer));
+    PETSC_CHECK(PetscViewerHDF5Open(PETSC_COMM_WORLD, aux_file_name,
+                                    FILE_MODE_WRITE, &viewer));
+  }
+  if (geometry) {
+    result = write_fv_geometry(viewer, geometry);
+  }
+  if (partition && !result.err_code) {
+    result = write_partition(viewer, partition);
+  }
+
+finished:
+  if (viewer) PetscViewerDestroy(&viewer);
+  return result;
+}
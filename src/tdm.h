@@ -4,6 +4,8 @@
 #include <lib_jigsaw.h>
 #include <petsc.h>
 
+#include <stdbool.h>
+
 // TDM can output meshes in the Exodus or HDF5 formats.
 typedef enum {
   TDM_EXODUS,
@@ -21,6 +23,10 @@ typedef struct tdm_config_t {
   // jigsaw surface triangulation settings
   jigsaw_jig_t jigsaw;
 
+  // surface decimation parameters
+  real_t  decimation_max_error; // max vertical error [m] (0 -> no decimation)
+  real_t  decimation_min_angle; // min triangle angle [degrees]
+
   // extrusion parameters
   int     num_layers;
   real_t  total_layer_thickness;
@@ -31,6 +37,12 @@ typedef struct tdm_config_t {
   const char       *surface_mesh_file;
   tdm_mesh_format_t column_mesh_format;
   const char       *column_mesh_file;
+  bool              column_mesh_fv_geometry; // store finite-volume geometry?
+
+  // partitioning settings
+  int         num_ranks;          // target number of ranks (0 -> none)
+  const char *column_cost_file;   // per-point computational cost (optional)
+  bool        compare_partitions; // report quality vs. a 3D partition?
 
 } tdm_config_t;
 
@@ -44,12 +56,93 @@ typedef struct tdm_result_t {
   char err_msg[TDM_MAX_ERR_LEN]; // error string
 } tdm_result_t;
 
-// This is a point in 3D space with a mask value of 1 or 0.
+// This is a point in 3D space with a mask value of 1 or 0, and the relative
+// computational cost of the column beneath it (1 unless given).
 typedef struct point_t {
   real_t x, y, z;
   int mask;
+  real_t cost;
 } point_t;
 
+// These are the stages of the meshing workflow, used to break down resource
+// estimates.
+typedef enum {
+  TDM_STAGE_READ,        // reading DEM/lat/lon/mask data
+  TDM_STAGE_TRIANGULATE, // generating the surface mesh with jigsaw
+  TDM_STAGE_EXTRUDE,     // extruding the surface mesh to columns
+  TDM_STAGE_WRITE,       // writing meshes to disk
+  TDM_NUM_STAGES
+} tdm_stage_t;
+
+// This struct holds a prediction of the sizes of the meshes generated for a
+// given configuration, and of the resources needed to generate them.
+typedef struct tdm_estimate_t {
+  // input raster dimensions
+  size_t num_rows, num_cols;
+  size_t num_masked_points;
+
+  // predicted mesh sizes
+  size_t num_surface_vertices;
+  size_t num_surface_triangles;
+  size_t num_column_cells;
+
+  // predicted peak memory [bytes] and wall time [s] for each stage (for the
+  // write stage, the memory is the total over all ranks)
+  size_t stage_memory[TDM_NUM_STAGES];
+  double stage_time[TDM_NUM_STAGES];
+
+  // totals over all stages
+  size_t peak_memory;
+  double total_time;
+
+  // memory needed on every rank by the stages that run in full on each rank
+  // (reading, triangulation, and extrusion), however many ranks are used
+  size_t serial_memory;
+
+  // recommended number of MPI ranks for the job, the memory each rank needs
+  // with that many ranks, and the memory assumed to be available to a rank
+  int    num_ranks;
+  size_t rank_memory;
+  size_t memory_per_rank;
+} tdm_estimate_t;
+
+// The number of faces on a triangular prism.
+#define TDM_PRISM_NUM_FACES 5
+
+// This struct holds precomputed finite-volume geometry and connectivity for a
+// column mesh of prisms. Cells are numbered column by column--all layers of
+// the first surface triangle (starting at the top), then all layers of the
+// second, and so on--matching the numbering produced by DMPlexExtrude. Each
+// cell's faces are ordered top, bottom, then the three lateral faces (in the
+// order of the surface triangle's edges). On a mesh distributed by
+// distribute_column_mesh, the geometry instead covers only the cells owned by
+// each rank, in local order, and neighbors are given by their global cell
+// numbers, matching the cell order of the written mesh.
+typedef struct tdm_fv_geometry_t {
+  PetscInt   num_cells;
+  PetscReal *cell_volumes;   // [num_cells]
+  PetscReal *cell_centroids; // [3*num_cells]
+  PetscReal *face_areas;     // [TDM_PRISM_NUM_FACES*num_cells]
+  PetscReal *face_normals;   // [3*TDM_PRISM_NUM_FACES*num_cells], outward
+  PetscInt  *cell_neighbors; // [TDM_PRISM_NUM_FACES*num_cells], -1 on boundary
+} tdm_fv_geometry_t;
+
+// This struct describes a partitioning of a column mesh among a number of
+// ranks, with a one-cell overlap (a layer of ghost cells) between neighboring
+// partitions. Columns are never split between ranks. Cells are numbered as in
+// tdm_fv_geometry_t, and the cells owned by (and ghosted to) each rank are
+// stored contiguously, with offsets given for each rank.
+typedef struct tdm_partition_t {
+  int       num_ranks;
+  PetscInt  num_cells;
+  PetscInt *cell_owners;   // [num_cells] rank owning each cell
+  PetscInt *owned_offsets; // [num_ranks+1] offsets into owned_cells
+  PetscInt *owned_cells;   // [num_cells] cells owned by each rank
+  PetscInt *ghost_offsets; // [num_ranks+1] offsets into ghost_cells/owners
+  PetscInt *ghost_cells;   // cells ghosted to each rank
+  PetscInt *ghost_owners;  // ranks owning those ghost cells
+} tdm_partition_t;
+
 // Use this one-liner to create a result type with an error code and
 // a string.
 tdm_result_t tdm_result(int err_code, const char *fmt, ...);
@@ -60,6 +153,13 @@ tdm_result_t extract_points(tdm_config_t config,
                             size_t      *num_points,
                             point_t    **points);
 
+// Predicts the sizes of the surface and column meshes for the given
+// configuration, and the memory and time needed to produce them, without
+// generating any meshes. Only the mask file (and, for absolute hfun settings,
+// the lat/lon files) are scanned.
+tdm_result_t estimate_resources(tdm_config_t    config,
+                                tdm_estimate_t *estimate);
+
 // Generates a triangulated surface mesh from the given DEM file, storing the
 // surface mesh in the given DM.
 tdm_result_t triangulate_dem(tdm_config_t config,
@@ -67,13 +167,97 @@ tdm_result_t triangulate_dem(tdm_config_t config,
                              point_t      points[num_points],
                              DM          *surface_mesh);
 
+// Coarsens the given surface mesh by collapsing edges in order of increasing
+// quadric error, as long as no point in the DEM deviates vertically from the
+// coarsened surface by more than config.decimation_max_error and no new
+// triangle has an angle smaller than config.decimation_min_angle. Vertices on
+// the boundary of the mesh are never removed. Independent sets of collapses are
+// applied in parallel by OMP_NUM_THREADS threads on each rank (by default, the
+// node's processors divided among the ranks on the node). The coarsened mesh
+// is stored in decimated_mesh.
+tdm_result_t decimate_surface_mesh(tdm_config_t config,
+                                   size_t       num_points,
+                                   point_t      points[num_points],
+                                   DM           surface_mesh,
+                                   DM          *decimated_mesh);
+
 // Given a surface mesh, this function extrudes each 2D cell to a column of
-// prisms, producing a 3D column mesh.
+// prisms, producing a 3D column mesh. If the configuration requests it, the
+// column mesh's finite-volume geometry is computed and attached to it.
 tdm_result_t extrude_surface_mesh(tdm_config_t config,
                                   DM           surface_mesh,
                                   DM          *column_mesh);
 
-// Writes the given mesh to a format indicated by the given configuration.
+// Computes the finite-volume geometry of the column mesh obtained by extruding
+// the given surface mesh with the given configuration. Because each prism is a
+// vertical translate of its surface triangle, this only requires the surface
+// mesh and the layer thicknesses.
+tdm_result_t compute_fv_geometry(tdm_config_t       config,
+                                 DM                 surface_mesh,
+                                 tdm_fv_geometry_t *geometry);
+
+// Frees the resources allocated to the given finite-volume geometry.
+void destroy_fv_geometry(tdm_fv_geometry_t *geometry);
+
+// Retrieves the finite-volume geometry attached to the given column mesh by
+// extrude_surface_mesh (or distribute_column_mesh), storing NULL in *geometry
+// if there is none. The mesh retains ownership of the geometry.
+tdm_result_t get_column_mesh_fv_geometry(DM                  column_mesh,
+                                         tdm_fv_geometry_t **geometry);
+
+// Partitions the column mesh extruded from the given surface mesh among
+// config.num_ranks ranks by partitioning the surface mesh and assigning every
+// prism in a column to its triangle's rank. Each column is weighted by the
+// cost of the nearest of the given points. A one-cell overlap is computed for
+// each partition, and the result is attached to the column mesh for output.
+tdm_result_t partition_column_mesh(tdm_config_t config,
+                                   size_t       num_points,
+                                   point_t      points[num_points],
+                                   DM           surface_mesh,
+                                   DM           column_mesh);
+
+// Distributes the column mesh extruded from the given surface mesh among the
+// ranks in its communicator, partitioning it in the same column-preserving
+// way as partition_column_mesh, with a one-cell overlap of face neighbors.
+// Attached finite-volume geometry is migrated to the distributed mesh, and an
+// attached partition (from partition_column_mesh) is renumbered to match the
+// distributed mesh's global cell numbering. If there's only one rank,
+// *distributed_mesh is set to NULL.
+tdm_result_t distribute_column_mesh(tdm_config_t config,
+                                    size_t       num_points,
+                                    point_t      points[num_points],
+                                    DM           surface_mesh,
+                                    DM           column_mesh,
+                                    DM          *distributed_mesh);
+
+// Builds a partition of a column mesh with the given number of layers among
+// num_ranks ranks from the owning ranks of its columns and the adjacency graph
+// of its surface mesh (in the CSR format used by PetscPartitioner, with
+// columns numbered as surface triangles). This is the step of
+// partition_column_mesh that follows the partitioning of the surface mesh.
+void build_partition(int              num_ranks,
+                     PetscInt         num_layers,
+                     PetscInt         num_columns,
+                     const PetscInt   column_owners[num_columns],
+                     const PetscInt   offsets[num_columns+1],
+                     const PetscInt   adjacency[],
+                     tdm_partition_t *partition);
+
+// Retrieves the partition attached to the given column mesh by
+// partition_column_mesh (or distribute_column_mesh), storing NULL in
+// *partition if there is none. The mesh retains ownership of the partition.
+tdm_result_t get_column_mesh_partition(DM                column_mesh,
+                                       tdm_partition_t **partition);
+
+// Frees the resources allocated to the given partition.
+void destroy_partition(tdm_partition_t *partition);
+
+// Writes the given mesh to a format indicated by the given configuration. Any
+// finite-volume geometry or partitioning attached to the mesh is written
+// alongside it as HDF5 datasets in the /fv_geometry and /partition groups--in
+// the mesh file itself for HDF5 output, or in a separate file (with ".h5"
+// appended to its name) for Exodus output. (PETSc's own /geometry group, which
+// holds the mesh's vertex coordinates, is left alone.)
 tdm_result_t write_mesh(tdm_config_t config, DM mesh, const char *prefix);
 
 
@@ -0,0 +1,44 @@
+#ifndef TDM_TEST_H
+#define TDM_TEST_H
+
+// This header holds the helpers shared by tdm's test programs, each of which
+// runs its checks, reports any failures, and returns nonzero if there were
+// any.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The number of checks that have failed in this test program.
+static int num_failures = 0;
+
+// This macro reports a failed check without stopping the test.
+#define CHECK(condition) \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+            #condition); \
+    ++num_failures; \
+  }
+
+// This macro calls a PETSc function and stops the test if it fails, since the
+// remaining checks would be meaningless. (tdm's own PETSC_CHECK instead
+// converts the error to a tdm_result_t for its caller.)
+#define CHECK_PETSC(call) \
+  { \
+    PetscErrorCode ierr_ = call; \
+    if (ierr_) { \
+      fprintf(stderr, "%s:%d: PETSc error %d in %s\n", __FILE__, __LINE__, \
+              ierr_, #call); \
+      exit(1); \
+    } \
+  }
+
+// Reports the number of failed checks (if any), returning the exit code for
+// the test program.
+static inline int test_summary(const char *exe_name) {
+  if (num_failures) {
+    fprintf(stderr, "%s: %d check(s) failed.\n", exe_name, num_failures);
+  }
+  return (num_failures) ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,215 @@
+// This program checks decimate_surface_mesh on a planar grid whose DEM samples
+// lie on a tilted plane, so that the interior of the grid can be coarsened
+// away without error, and on a grid following a trough, which can only be
+// coarsened along the trough.
+
+#include "tdm.h"
+#include "tdm_test.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The surface mesh is an N x N grid of vertices spaced H meters apart, with
+// each square split into two triangles. The DEM is sampled twice as finely.
+#define N 9
+#define H 10.0
+#define NUM_SAMPLES ((2*N-1) * (2*N-1))
+
+// The surface on which the mesh and the DEM lie: a tilted plane with a trough
+// of the given curvature running along the y axis.
+static PetscReal curvature = 0.0;
+static PetscReal surface(PetscReal x, PetscReal y) {
+  PetscReal dx = x - 0.5*H*(N-1);
+  return 100.0 + 0.5*x + 0.25*y + curvature*dx*dx;
+}
+
+// Creates the surface mesh described above.
+static DM create_surface_mesh(void) {
+  PetscReal coords[3*N*N];
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      PetscReal *x = &coords[3*(N*i+j)];
+      x[0] = H * j;
+      x[1] = H * i;
+      x[2] = surface(x[0], x[1]);
+    }
+  }
+  PetscInt cells[3*2*(N-1)*(N-1)];
+  int t = 0;
+  for (int i = 0; i < N-1; ++i) {
+    for (int j = 0; j < N-1; ++j) {
+      PetscInt v = N*i + j;
+      cells[3*t] = v; cells[3*t+1] = v+1;   cells[3*t+2] = v+N+1; ++t;
+      cells[3*t] = v; cells[3*t+1] = v+N+1; cells[3*t+2] = v+N;   ++t;
+    }
+  }
+  DM surface_mesh;
+  CHECK_PETSC(DMPlexCreateFromCellListPetsc(PETSC_COMM_WORLD, 2, t, N*N, 3,
+                                            PETSC_TRUE, cells, 3, coords,
+                                            &surface_mesh));
+  return surface_mesh;
+}
+
+// Returns the smallest interior angle [degrees] of the triangle with the
+// given vertices.
+static PetscReal min_angle(PetscReal x[3][3]) {
+  PetscReal min = 180.0;
+  for (int j = 0; j < 3; ++j) {
+    const PetscReal *a = x[j], *b = x[(j+1)%3], *c = x[(j+2)%3];
+    PetscReal dot = 0.0, uu = 0.0, vv = 0.0;
+    for (int d = 0; d < 3; ++d) {
+      dot += (b[d] - a[d]) * (c[d] - a[d]);
+      uu += (b[d] - a[d]) * (b[d] - a[d]);
+      vv += (c[d] - a[d]) * (c[d] - a[d]);
+    }
+    PetscReal cos_angle = dot / sqrt(uu * vv);
+    PetscReal angle = acos(fmin(1.0, fmax(-1.0, cos_angle))) * 180.0 / M_PI;
+    if (min > angle) min = angle;
+  }
+  return min;
+}
+
+// Checks the decimated mesh against the original grid and the DEM samples.
+static void check_decimated_mesh(tdm_config_t config,
+                                 point_t      samples[NUM_SAMPLES],
+                                 DM           mesh) {
+  PetscInt c_start, c_end, v_start, v_end;
+  CHECK_PETSC(DMPlexGetHeightStratum(mesh, 0, &c_start, &c_end));
+  CHECK_PETSC(DMPlexGetDepthStratum(mesh, 0, &v_start, &v_end));
+  PetscInt num_tris = c_end - c_start, num_vertices = v_end - v_start;
+
+  Vec coord_vec;
+  PetscSection coord_section;
+  const PetscScalar *coords;
+  CHECK_PETSC(DMGetCoordinateSection(mesh, &coord_section));
+  CHECK_PETSC(DMGetCoordinatesLocal(mesh, &coord_vec));
+  CHECK_PETSC(VecGetArrayRead(coord_vec, &coords));
+
+  // Every vertex still lies on the surface, and every boundary vertex of the
+  // grid survives.
+  PetscInt num_boundary_vertices = 0;
+  for (PetscInt v = v_start; v < v_end; ++v) {
+    PetscInt offset;
+    CHECK_PETSC(PetscSectionGetOffset(coord_section, v, &offset));
+    PetscReal x = PetscRealPart(coords[offset]),
+              y = PetscRealPart(coords[offset+1]),
+              z = PetscRealPart(coords[offset+2]);
+    CHECK(fabs(z - surface(x, y)) < 1e-8);
+    if ((x == 0.0) || (x == H*(N-1)) || (y == 0.0) || (y == H*(N-1))) {
+      ++num_boundary_vertices;
+    }
+  }
+  CHECK(num_boundary_vertices == 4*(N-1));
+
+  // The mesh is still a triangulated disk (T = 2V - B - 2).
+  CHECK(num_tris == 2*num_vertices - num_boundary_vertices - 2);
+
+  // The triangles tile the square, respect the minimum angle, and reproduce
+  // every DEM sample to within the maximum error.
+  PetscReal area = 0.0, max_dev = 0.0;
+  int covered[NUM_SAMPLES] = {0};
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt closure_size, *closure = NULL, nv = 0;
+    PetscReal x[3][3];
+    CHECK_PETSC(DMPlexGetTransitiveClosure(mesh, c, PETSC_TRUE, &closure_size,
+                                           &closure));
+    for (PetscInt i = 0; i < closure_size; ++i) {
+      PetscInt p = closure[2*i], offset;
+      if ((p >= v_start) && (p < v_end) && (nv < 3)) {
+        CHECK_PETSC(PetscSectionGetOffset(coord_section, p, &offset));
+        for (int d = 0; d < 3; ++d) x[nv][d] = PetscRealPart(coords[offset+d]);
+        ++nv;
+      }
+    }
+    CHECK_PETSC(DMPlexRestoreTransitiveClosure(mesh, c, PETSC_TRUE,
+                                               &closure_size, &closure));
+    CHECK(nv == 3);
+    if (nv != 3) continue;
+
+    PetscReal det = (x[1][0] - x[0][0]) * (x[2][1] - x[0][1]) -
+                    (x[2][0] - x[0][0]) * (x[1][1] - x[0][1]);
+    area += 0.5 * fabs(det);
+    CHECK(min_angle(x) >= config.decimation_min_angle - 1e-8);
+
+    for (int s = 0; s < NUM_SAMPLES; ++s) {
+      PetscReal dx = samples[s].x - x[0][0], dy = samples[s].y - x[0][1];
+      PetscReal b1 = (dx * (x[2][1] - x[0][1]) - dy * (x[2][0] - x[0][0])) / det,
+                b2 = (dy * (x[1][0] - x[0][0]) - dx * (x[1][1] - x[0][1])) / det,
+                b0 = 1.0 - b1 - b2;
+      if ((b0 < -1e-10) || (b1 < -1e-10) || (b2 < -1e-10)) continue;
+      PetscReal z = b0 * x[0][2] + b1 * x[1][2] + b2 * x[2][2];
+      PetscReal dev = fabs(z - samples[s].z);
+      if (max_dev < dev) max_dev = dev;
+      covered[s] = 1;
+    }
+  }
+  CHECK_PETSC(VecRestoreArrayRead(coord_vec, &coords));
+
+  CHECK(fabs(area - H*H*(N-1)*(N-1)) < 1e-6 * H*H*(N-1)*(N-1));
+  CHECK(max_dev <= config.decimation_max_error);
+  int num_covered = 0;
+  for (int s = 0; s < NUM_SAMPLES; ++s) num_covered += covered[s];
+  CHECK(num_covered == NUM_SAMPLES);
+}
+
+// Decimates the grid with the DEM sampled from the current surface, checking
+// the result and returning its number of triangles.
+static PetscInt decimate_grid(tdm_config_t config) {
+  point_t samples[NUM_SAMPLES];
+  for (int i = 0; i < 2*N-1; ++i) {
+    for (int j = 0; j < 2*N-1; ++j) {
+      point_t *p = &samples[(2*N-1)*i + j];
+      p->x = 0.5 * H * j;
+      p->y = 0.5 * H * i;
+      p->z = surface(p->x, p->y);
+      p->mask = 1;
+      p->cost = 1.0;
+    }
+  }
+
+  DM surface_mesh = create_surface_mesh(), decimated_mesh = NULL;
+  tdm_result_t result = decimate_surface_mesh(config, NUM_SAMPLES, samples,
+                                              surface_mesh, &decimated_mesh);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  PetscInt num_tris = 2*(N-1)*(N-1);
+  if (decimated_mesh) {
+    check_decimated_mesh(config, samples, decimated_mesh);
+    PetscInt c_start, c_end;
+    CHECK_PETSC(DMPlexGetHeightStratum(decimated_mesh, 0, &c_start, &c_end));
+    num_tris = c_end - c_start;
+    DMDestroy(&decimated_mesh);
+  }
+  DMDestroy(&surface_mesh);
+  return num_tris;
+}
+
+int main(int argc, char **argv) {
+  CHECK_PETSC(PetscInitialize(&argc, &argv, NULL, NULL));
+
+  // The grid's right triangles can't lose a vertex without creating an angle
+  // of atan(1/3) ~ 18.4 degrees, so we allow somewhat smaller angles.
+  tdm_config_t config = {
+    .decimation_max_error = 0.01,
+    .decimation_min_angle = 15.0,
+    .num_layers = 1,
+  };
+
+  // On a plane, most of the triangles go.
+  PetscInt num_planar_tris = decimate_grid(config);
+  CHECK(num_planar_tris <= (N-1)*(N-1));
+
+  // In a trough, whose linear interpolation on the grid deviates from the
+  // DEM by up to curvature*H*H/4 = 0.25 m (midway along the diagonals), some
+  // coarsening along the trough is possible, but less than on the plane.
+  curvature = 0.01;
+  config.decimation_max_error = 0.3;
+  PetscInt num_trough_tris = decimate_grid(config);
+  CHECK(num_trough_tris < 2*(N-1)*(N-1));
+  CHECK(num_trough_tris > num_planar_tris);
+
+  PetscFinalize();
+
+  return test_summary(argv[0]);
+}
@@ -0,0 +1,216 @@
+// This program checks distribute_column_mesh on two (or more) ranks: it
+// extrudes a small surface mesh held by the first rank, partitions it for a
+// target number of ranks, and distributes it, checking that its columns stay
+// whole, that the migrated finite-volume neighbors match the global cell
+// numbers of the distributed mesh, and that the migrated partition is
+// renumbered consistently.
+
+#include "tdm.h"
+#include "tdm_test.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The surface mesh is an N x N grid of vertices spaced H meters apart, with
+// each square split into two triangles.
+#define N 7
+#define H 10.0
+#define NUM_TRIS (2*(N-1)*(N-1))
+
+// Tolerance for comparing geometric quantities.
+#define TOL 1e-10
+
+// Creates the surface mesh described above on the first rank, with no cells
+// on the others, as for a mesh that hasn't been distributed yet.
+static DM create_surface_mesh(void) {
+  int rank;
+  MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+  PetscReal coords[3*N*N];
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      PetscReal *x = &coords[3*(N*i+j)];
+      x[0] = H * j;
+      x[1] = H * i;
+      x[2] = 100.0 + 0.1*x[0] + 0.2*x[1];
+    }
+  }
+  PetscInt cells[3*NUM_TRIS];
+  int t = 0;
+  for (int i = 0; i < N-1; ++i) {
+    for (int j = 0; j < N-1; ++j) {
+      PetscInt v = N*i + j;
+      cells[3*t] = v; cells[3*t+1] = v+1;   cells[3*t+2] = v+N+1; ++t;
+      cells[3*t] = v; cells[3*t+1] = v+N+1; cells[3*t+2] = v+N;   ++t;
+    }
+  }
+  DM surface_mesh;
+  CHECK_PETSC(DMPlexCreateFromCellListPetsc(PETSC_COMM_WORLD, 2,
+                                            (rank == 0) ? NUM_TRIS : 0,
+                                            (rank == 0) ? N*N : 0, 3,
+                                            PETSC_TRUE, cells, 3, coords,
+                                            &surface_mesh));
+  return surface_mesh;
+}
+
+// Returns the global number of the given local cell of a distributed mesh,
+// given the mesh's cell numbering (in which cells owned by other ranks are
+// encoded as -(number+1)).
+static PetscInt global_number(const PetscInt numbering[], PetscInt cell) {
+  PetscInt number = numbering[cell];
+  return (number >= 0) ? number : -(number + 1);
+}
+
+// Checks the distributed mesh and the geometry and partition migrated to it.
+static void check_distributed_mesh(tdm_config_t config, DM mesh) {
+  MPI_Comm comm = PETSC_COMM_WORLD;
+  PetscInt L = config.num_layers;
+
+  IS numbering_is;
+  const PetscInt *numbering;
+  PetscInt c_start, c_end;
+  CHECK_PETSC(DMPlexGetHeightStratum(mesh, 0, &c_start, &c_end));
+  CHECK_PETSC(DMPlexGetCellNumbering(mesh, &numbering_is));
+  CHECK_PETSC(ISGetIndices(numbering_is, &numbering));
+
+  // Each rank owns a contiguous range of global cell numbers.
+  PetscInt num_owned = 0, first = 0, num_cells = 0;
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    if (numbering[c - c_start] >= 0) ++num_owned;
+  }
+  MPI_Exscan(&num_owned, &first, 1, MPIU_INT, MPI_SUM, comm);
+  MPI_Allreduce(&num_owned, &num_cells, 1, MPIU_INT, MPI_SUM, comm);
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  if (rank == 0) first = 0;
+  CHECK(num_owned > 0);
+  CHECK(num_cells == NUM_TRIS * L);
+
+  tdm_fv_geometry_t *geometry = NULL;
+  tdm_result_t result = get_column_mesh_fv_geometry(mesh, &geometry);
+  CHECK(!result.err_code);
+  CHECK(geometry != NULL);
+  if (geometry) {
+    CHECK(geometry->num_cells == num_owned);
+  }
+  if (!geometry || (geometry->num_cells != num_owned)) {
+    // The other ranks would wait on us in the collective checks below.
+    MPI_Abort(comm, test_summary("test_distribute"));
+  }
+
+  // The migrated partition lives on one rank. Share its cell owners.
+  tdm_partition_t *partition = NULL;
+  result = get_column_mesh_partition(mesh, &partition);
+  CHECK(!result.err_code);
+  CHECK(partition != NULL);
+  int holder = (partition && (partition->num_cells > 0)) ? rank : -1;
+  MPI_Allreduce(MPI_IN_PLACE, &holder, 1, MPI_INT, MPI_MAX, comm);
+  CHECK(holder >= 0);
+  PetscInt *cell_owners = malloc(sizeof(PetscInt) * num_cells);
+  if (holder >= 0) {
+    if (rank == holder) {
+      CHECK(partition->num_cells == num_cells);
+      CHECK(partition->num_ranks == config.num_ranks);
+      for (PetscInt c = 0; c < num_cells; ++c) {
+        cell_owners[c] = partition->cell_owners[c];
+      }
+      for (int r = 0; r < partition->num_ranks; ++r) {
+        for (PetscInt i = partition->owned_offsets[r];
+             i < partition->owned_offsets[r+1]; ++i) {
+          CHECK(partition->cell_owners[partition->owned_cells[i]] == r);
+        }
+        for (PetscInt i = partition->ghost_offsets[r];
+             i < partition->ghost_offsets[r+1]; ++i) {
+          CHECK(partition->ghost_owners[i] ==
+                partition->cell_owners[partition->ghost_cells[i]]);
+          CHECK(partition->ghost_owners[i] != r);
+        }
+      }
+    } else if (partition) {
+      CHECK(partition->num_cells == 0);
+    }
+    MPI_Bcast(cell_owners, (int)num_cells, MPIU_INT, holder, comm);
+  }
+
+  PetscInt i = 0;
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt number = numbering[c - c_start];
+    if (number < 0) continue;
+    CHECK((number >= first) && (number < first + num_owned));
+
+    PetscReal volume, centroid[3];
+    CHECK_PETSC(DMPlexComputeCellGeometryFVM(mesh, c, &volume, centroid,
+                                             NULL));
+    CHECK(fabs(geometry->cell_volumes[i] - volume) < TOL * volume);
+
+    // Each face's neighbor is given by its global number.
+    const PetscInt *faces;
+    CHECK_PETSC(DMPlexGetCone(mesh, c, &faces));
+    const PetscInt *neighbors =
+      &geometry->cell_neighbors[TDM_PRISM_NUM_FACES*i];
+    for (int f = 0; f < TDM_PRISM_NUM_FACES; ++f) {
+      const PetscInt *support;
+      PetscInt support_size, neighbor = -1;
+      CHECK_PETSC(DMPlexGetSupportSize(mesh, faces[f], &support_size));
+      CHECK_PETSC(DMPlexGetSupport(mesh, faces[f], &support));
+      for (PetscInt s = 0; s < support_size; ++s) {
+        if (support[s] != c) {
+          neighbor = global_number(numbering, support[s] - c_start);
+        }
+      }
+      CHECK(neighbors[f] == neighbor);
+    }
+
+    // The cells above and below are owned by this rank, so the column is
+    // whole, and the same goes for the partition.
+    for (int f = 0; f < 2; ++f) {
+      if (neighbors[f] < 0) continue;
+      CHECK((neighbors[f] >= first) && (neighbors[f] < first + num_owned));
+      if (holder >= 0) {
+        CHECK(cell_owners[neighbors[f]] == cell_owners[number]);
+      }
+    }
+    ++i;
+  }
+  free(cell_owners);
+  CHECK_PETSC(ISRestoreIndices(numbering_is, &numbering));
+}
+
+int main(int argc, char **argv) {
+  CHECK_PETSC(PetscInitialize(&argc, &argv, NULL, NULL));
+  int num_procs;
+  MPI_Comm_size(PETSC_COMM_WORLD, &num_procs);
+  CHECK(num_procs > 1);
+
+  DM surface_mesh = create_surface_mesh(), column_mesh = NULL,
+     distributed_mesh = NULL;
+  tdm_config_t config = {
+    .num_layers = 3,
+    .total_layer_thickness = 3.0,
+    .column_mesh_fv_geometry = true,
+    .num_ranks = 3,
+  };
+  tdm_result_t result = extrude_surface_mesh(config, surface_mesh,
+                                             &column_mesh);
+  if (!result.err_code) {
+    result = partition_column_mesh(config, 0, NULL, surface_mesh,
+                                   column_mesh);
+  }
+  if (!result.err_code) {
+    result = distribute_column_mesh(config, 0, NULL, surface_mesh,
+                                    column_mesh, &distributed_mesh);
+  }
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  CHECK((num_procs == 1) || distributed_mesh);
+
+  if (distributed_mesh) {
+    check_distributed_mesh(config, distributed_mesh);
+    DMDestroy(&distributed_mesh);
+  }
+  if (column_mesh) DMDestroy(&column_mesh);
+  DMDestroy(&surface_mesh);
+  PetscFinalize();
+
+  return test_summary(argv[0]);
+}
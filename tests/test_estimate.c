@@ -0,0 +1,111 @@
+// This program checks estimate_resources against small rasters whose mesh
+// sizes can be worked out by hand.
+
+#include "stream.h"
+#include "tdm.h"
+#include "tdm_test.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// The raster used in these tests has N x N points, all within the domain.
+#define N 11
+
+// Writes an N x N raster whose value at row i and column j is
+// a + b*i + c*j to a new temporary file, storing its name in file.
+static void write_raster(char file[], real_t a, real_t b, real_t c) {
+  strcpy(file, "/tmp/tdm_test_XXXXXX");
+  FILE *f = fdopen(mkstemp(file), "w");
+  fprintf(f, "raster values\n"); // a header, which is skipped
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      fprintf(f, "%.10g ", a + b*i + c*j);
+    }
+    fprintf(f, "\n");
+  }
+  fclose(f);
+}
+
+int main(int argc, char **argv) {
+  char mask_file[32], lat_file[32], lon_file[32];
+  write_raster(mask_file, 1.0, 0.0, 0.0);
+  write_raster(lat_file, 45.0, 0.001, 0.0);    // 45.00 - 45.01 N
+  write_raster(lon_file, -110.0, 0.0, 0.001);  // 110.00 - 109.99 W
+  tdm_config_t config = {
+    .mask_file = mask_file,
+    .lat_file = lat_file,
+    .lon_file = lon_file,
+    .num_layers = 10
+  };
+
+  // Relative hfun: edge lengths are measured in raster cells.
+  config.jigsaw._hfun_scal = JIGSAW_HFUN_RELATIVE;
+  config.jigsaw._hfun_hmax = 0.1; // -> ~1 raster cell
+  tdm_estimate_t estimate;
+  tdm_result_t result = estimate_resources(config, &estimate);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  CHECK(estimate.num_rows == N);
+  CHECK(estimate.num_cols == N);
+  CHECK(estimate.num_masked_points == N*N);
+  real_t h = 0.1 * N;
+  size_t num_tris = (size_t)ceil(N*N / (0.25 * sqrt(3.0) * h * h));
+  CHECK(estimate.num_surface_triangles == num_tris);
+  CHECK(estimate.num_column_cells == 10 * num_tris);
+  CHECK(estimate.stage_memory[TDM_STAGE_READ] >= TDM_STREAM_MEMORY);
+  CHECK(estimate.peak_memory > 0);
+  CHECK(estimate.serial_memory >= estimate.stage_memory[TDM_STAGE_READ]);
+  CHECK(estimate.num_ranks == 1); // a tiny mesh
+  CHECK(estimate.rank_memory >= estimate.serial_memory);
+  CHECK(estimate.rank_memory <= estimate.memory_per_rank);
+
+  // Finite-volume geometry (24 reals and 5 integers per prism) adds to the
+  // memory needed by the extrusion and by the distributed column mesh.
+  tdm_estimate_t fv_estimate;
+  config.column_mesh_fv_geometry = true;
+  result = estimate_resources(config, &fv_estimate);
+  config.column_mesh_fv_geometry = false;
+  CHECK(!result.err_code);
+  size_t fv_memory = (24 * sizeof(PetscReal) + 5 * sizeof(PetscInt)) *
+                     estimate.num_column_cells;
+  CHECK(fv_estimate.num_column_cells == estimate.num_column_cells);
+  CHECK(fv_estimate.stage_memory[TDM_STAGE_EXTRUDE] >=
+        estimate.stage_memory[TDM_STAGE_EXTRUDE] + fv_memory);
+  CHECK(fv_estimate.stage_memory[TDM_STAGE_WRITE] >=
+        estimate.stage_memory[TDM_STAGE_WRITE] + fv_memory);
+  CHECK(fv_estimate.stage_memory[TDM_STAGE_READ] ==
+        estimate.stage_memory[TDM_STAGE_READ]);
+
+  // Absolute hfun: at 45 degrees north, a degree of longitude spans about
+  // 78.85 km and a degree of latitude about 111.13 km.
+  config.jigsaw._hfun_scal = JIGSAW_HFUN_ABSOLUTE;
+  config.jigsaw._hfun_hmax = 50.0; // [m]
+  result = estimate_resources(config, &estimate);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  real_t area = N*N * (0.001 * 78847.0) * (0.001 * 111131.8);
+  real_t expected = area / (0.25 * sqrt(3.0) * 50.0 * 50.0);
+  CHECK(fabs(estimate.num_surface_triangles - expected) < 0.001 * expected);
+
+  // With half-meter triangles, the column mesh needs many ranks, but adding
+  // ranks doesn't reduce the memory needed by the serial stages, which exceeds
+  // what a rank has.
+  config.jigsaw._hfun_hmax = 0.5; // [m]
+  result = estimate_resources(config, &estimate);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  size_t write_memory = estimate.stage_memory[TDM_STAGE_WRITE];
+  CHECK(estimate.num_ranks > 1);
+  CHECK(estimate.num_ranks * estimate.memory_per_rank >= write_memory);
+  CHECK(estimate.serial_memory >= estimate.stage_memory[TDM_STAGE_EXTRUDE]);
+  CHECK(estimate.serial_memory > estimate.memory_per_rank);
+  CHECK(estimate.rank_memory == estimate.serial_memory);
+
+  unlink(mask_file);
+  unlink(lat_file);
+  unlink(lon_file);
+  return test_summary(argv[0]);
+}
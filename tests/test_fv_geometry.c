@@ -0,0 +1,147 @@
+// This program checks compute_fv_geometry against the cell geometry PETSc
+// computes for the column mesh extruded from a small hand-built surface mesh.
+
+#include "tdm.h"
+#include "tdm_test.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The surface mesh is a 3 x 3 grid of vertices split into 8 triangles, on a
+// tilted, bumpy surface so that no two triangles share a normal.
+#define NUM_VERTICES 9
+#define NUM_TRIS     8
+
+// Tolerance for comparing geometric quantities.
+#define TOL 1e-10
+
+// Creates the surface mesh described above.
+static DM create_surface_mesh(void) {
+  PetscReal coords[3*NUM_VERTICES];
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      PetscReal *x = &coords[3*(3*i+j)];
+      x[0] = 10.0 * j + ((i == 1) ? 2.0 : 0.0);
+      x[1] = 10.0 * i;
+      x[2] = 100.0 + 0.1*x[0] + 0.2*x[1] + ((i == 1 && j == 1) ? 3.0 : 0.0);
+    }
+  }
+  PetscInt cells[3*NUM_TRIS];
+  int t = 0;
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      PetscInt v = 3*i + j;
+      cells[3*t] = v; cells[3*t+1] = v+1; cells[3*t+2] = v+4; ++t;
+      cells[3*t] = v; cells[3*t+1] = v+4; cells[3*t+2] = v+3; ++t;
+    }
+  }
+  DM surface_mesh;
+  CHECK_PETSC(DMPlexCreateFromCellListPetsc(PETSC_COMM_WORLD, 2, NUM_TRIS,
+                                            NUM_VERTICES, 3, PETSC_TRUE, cells,
+                                            3, coords, &surface_mesh));
+  return surface_mesh;
+}
+
+// Compares the given geometry with that of the given column mesh.
+static void check_geometry(tdm_config_t       config,
+                           DM                 column_mesh,
+                           tdm_fv_geometry_t *geometry) {
+  PetscInt c_start, c_end;
+  CHECK_PETSC(DMPlexGetHeightStratum(column_mesh, 0, &c_start, &c_end));
+  CHECK(c_end - c_start == NUM_TRIS * config.num_layers);
+  CHECK(geometry->num_cells == c_end - c_start);
+  if (geometry->num_cells != c_end - c_start) return;
+
+  for (PetscInt c = c_start; c < c_end; ++c) {
+    PetscInt cell = c - c_start;
+
+    PetscReal volume, centroid[3];
+    CHECK_PETSC(DMPlexComputeCellGeometryFVM(column_mesh, c, &volume, centroid,
+                                             NULL));
+    CHECK(fabs(geometry->cell_volumes[cell] - volume) < TOL * volume);
+    for (int d = 0; d < 3; ++d) {
+      CHECK(fabs(geometry->cell_centroids[3*cell+d] - centroid[d]) <
+            TOL * (1.0 + fabs(centroid[d])));
+    }
+
+    // Faces are ordered as in the cell's cone: top, bottom, then the lateral
+    // faces in the order of the surface triangle's edges.
+    const PetscInt *faces;
+    PetscInt num_faces;
+    CHECK_PETSC(DMPlexGetConeSize(column_mesh, c, &num_faces));
+    CHECK(num_faces == TDM_PRISM_NUM_FACES);
+    if (num_faces != TDM_PRISM_NUM_FACES) continue;
+    CHECK_PETSC(DMPlexGetCone(column_mesh, c, &faces));
+    for (int f = 0; f < TDM_PRISM_NUM_FACES; ++f) {
+      PetscReal area, face_centroid[3], face_normal[3];
+      CHECK_PETSC(DMPlexComputeCellGeometryFVM(column_mesh, faces[f], &area,
+                                               face_centroid, face_normal));
+      CHECK(fabs(geometry->face_areas[TDM_PRISM_NUM_FACES*cell+f] - area) <
+            TOL * area);
+
+      // PETSc orients a face's normal by the face itself, so we check that
+      // ours is parallel to it and points away from the cell's centroid.
+      const PetscReal *n =
+        &geometry->face_normals[3*(TDM_PRISM_NUM_FACES*cell+f)];
+      PetscReal n_dot_n = 0.0, n_dot_face = 0.0, face_dot_face = 0.0,
+                n_dot_out = 0.0;
+      for (int d = 0; d < 3; ++d) {
+        n_dot_n += n[d] * n[d];
+        n_dot_face += n[d] * face_normal[d];
+        face_dot_face += face_normal[d] * face_normal[d];
+        n_dot_out += n[d] * (face_centroid[d] - centroid[d]);
+      }
+      CHECK(fabs(n_dot_n - 1.0) < TOL);
+      CHECK(fabs(fabs(n_dot_face) - sqrt(face_dot_face)) <
+            TOL * sqrt(face_dot_face));
+      CHECK(n_dot_out > 0.0);
+
+      const PetscInt *support;
+      PetscInt support_size, neighbor = -1;
+      CHECK_PETSC(DMPlexGetSupportSize(column_mesh, faces[f], &support_size));
+      CHECK_PETSC(DMPlexGetSupport(column_mesh, faces[f], &support));
+      for (PetscInt i = 0; i < support_size; ++i) {
+        if (support[i] != c) neighbor = support[i] - c_start;
+      }
+      CHECK(geometry->cell_neighbors[TDM_PRISM_NUM_FACES*cell+f] == neighbor);
+    }
+
+    // The top and bottom faces are neighbored by the cells above and below.
+    PetscInt k = cell % config.num_layers;
+    const PetscInt *N = &geometry->cell_neighbors[TDM_PRISM_NUM_FACES*cell];
+    CHECK(N[0] == ((k > 0) ? cell - 1 : -1));
+    CHECK(N[1] == ((k < config.num_layers - 1) ? cell + 1 : -1));
+  }
+}
+
+int main(int argc, char **argv) {
+  CHECK_PETSC(PetscInitialize(&argc, &argv, NULL, NULL));
+
+  DM surface_mesh = create_surface_mesh(), column_mesh;
+  real_t thicknesses[3] = {1.0, 2.0, 0.5};
+  tdm_config_t config = {
+    .num_layers = 3,
+    .total_layer_thickness = 3.5,
+    .layer_thicknesses = thicknesses,
+  };
+
+  tdm_result_t result = extrude_surface_mesh(config, surface_mesh,
+                                             &column_mesh);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+
+  tdm_fv_geometry_t geometry;
+  result = compute_fv_geometry(config, surface_mesh, &geometry);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+
+  if (num_failures == 0) check_geometry(config, column_mesh, &geometry);
+
+  destroy_fv_geometry(&geometry);
+  DMDestroy(&column_mesh);
+  DMDestroy(&surface_mesh);
+  PetscFinalize();
+
+  return test_summary(argv[0]);
+}
@@ -0,0 +1,205 @@
+// This program checks build_partition on a small strip of columns whose
+// owners are set by hand, and checks that the partition computed by
+// partition_column_mesh for an extruded grid keeps its columns whole and
+// ghosts exactly the lateral face neighbors of each rank's columns.
+
+#include "tdm.h"
+#include "tdm_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks that the given partition assigns each column of the given number of
+// layers to a single rank, that each rank's owned cells are those it owns,
+// and that no rank ghosts its own cells.
+static void check_columns(tdm_partition_t *partition, PetscInt num_layers) {
+  PetscInt L = num_layers;
+  CHECK(partition->owned_offsets[0] == 0);
+  CHECK(partition->owned_offsets[partition->num_ranks] == partition->num_cells);
+  CHECK(partition->ghost_offsets[0] == 0);
+  for (PetscInt c = 0; c < partition->num_cells; ++c) {
+    CHECK(partition->cell_owners[c] == partition->cell_owners[c - c % L]);
+  }
+  for (int r = 0; r < partition->num_ranks; ++r) {
+    for (PetscInt i = partition->owned_offsets[r];
+         i < partition->owned_offsets[r+1]; ++i) {
+      CHECK(partition->cell_owners[partition->owned_cells[i]] == r);
+    }
+    for (PetscInt i = partition->ghost_offsets[r];
+         i < partition->ghost_offsets[r+1]; ++i) {
+      CHECK(partition->ghost_owners[i] != r);
+      CHECK(partition->ghost_owners[i] ==
+            partition->cell_owners[partition->ghost_cells[i]]);
+    }
+  }
+}
+
+// Checks build_partition on a strip of two squares, each split into two
+// triangles (0: lower left, 1: upper left, 2: lower right, 3: upper right),
+// extruded to two layers. The triangles' adjacency is 1-0-3-2. Column 0
+// belongs to rank 1 and the others to rank 0, so column 0 borders two of
+// rank 0's columns but must be ghosted to it only once. Rank 2 gets nothing.
+static void test_strip(void) {
+  const PetscInt L = 2;
+  const PetscInt owners[4] = {1, 0, 0, 0};
+  const PetscInt offsets[5] = {0, 2, 3, 4, 6};
+  const PetscInt adjacency[6] = {1, 3, 0, 3, 0, 2};
+  tdm_partition_t partition;
+  build_partition(3, L, 4, owners, offsets, adjacency, &partition);
+
+  CHECK(partition.num_ranks == 3);
+  CHECK(partition.num_cells == 8);
+  const PetscInt cell_owners[8] = {1, 1, 0, 0, 0, 0, 0, 0};
+  CHECK(!memcmp(partition.cell_owners, cell_owners, sizeof(cell_owners)));
+
+  const PetscInt owned_offsets[4] = {0, 6, 8, 8},
+                 owned_cells[8] = {2, 3, 4, 5, 6, 7, 0, 1};
+  CHECK(!memcmp(partition.owned_offsets, owned_offsets,
+                sizeof(owned_offsets)));
+  CHECK(!memcmp(partition.owned_cells, owned_cells, sizeof(owned_cells)));
+
+  const PetscInt ghost_offsets[4] = {0, 2, 6, 6},
+                 ghost_cells[6] = {0, 1, 2, 3, 6, 7},
+                 ghost_owners[6] = {1, 1, 0, 0, 0, 0};
+  CHECK(!memcmp(partition.ghost_offsets, ghost_offsets,
+                sizeof(ghost_offsets)));
+  if (partition.ghost_offsets[3] == 6) {
+    CHECK(!memcmp(partition.ghost_cells, ghost_cells, sizeof(ghost_cells)));
+    CHECK(!memcmp(partition.ghost_owners, ghost_owners,
+                  sizeof(ghost_owners)));
+  }
+
+  check_columns(&partition, L);
+  destroy_partition(&partition);
+}
+
+// The surface mesh for the mesh test is an N x N grid of vertices spaced H
+// meters apart, with each square split into two triangles.
+#define N 7
+#define H 10.0
+
+// Creates the surface mesh described above.
+static DM create_surface_mesh(void) {
+  PetscReal coords[3*N*N];
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      PetscReal *x = &coords[3*(N*i+j)];
+      x[0] = H * j;
+      x[1] = H * i;
+      x[2] = 100.0 + 0.1*x[0];
+    }
+  }
+  PetscInt cells[3*2*(N-1)*(N-1)];
+  int t = 0;
+  for (int i = 0; i < N-1; ++i) {
+    for (int j = 0; j < N-1; ++j) {
+      PetscInt v = N*i + j;
+      cells[3*t] = v; cells[3*t+1] = v+1;   cells[3*t+2] = v+N+1; ++t;
+      cells[3*t] = v; cells[3*t+1] = v+N+1; cells[3*t+2] = v+N;   ++t;
+    }
+  }
+  DM surface_mesh;
+  CHECK_PETSC(DMPlexCreateFromCellListPetsc(PETSC_COMM_WORLD, 2, t, N*N, 3,
+                                            PETSC_TRUE, cells, 3, coords,
+                                            &surface_mesh));
+  return surface_mesh;
+}
+
+// Returns true if the given cell is in the given rank's ghost cells.
+static bool is_ghost(tdm_partition_t *partition, int rank, PetscInt cell) {
+  for (PetscInt i = partition->ghost_offsets[rank];
+       i < partition->ghost_offsets[rank+1]; ++i) {
+    if (partition->ghost_cells[i] == cell) return true;
+  }
+  return false;
+}
+
+// Checks the partition computed by partition_column_mesh for the column mesh
+// extruded from the grid: every ghost cell of a rank must share a lateral
+// face with one of the rank's cells, and every such neighbor owned by another
+// rank must be a ghost.
+static void test_column_mesh(void) {
+  DM surface_mesh = create_surface_mesh(), column_mesh;
+  tdm_config_t config = {
+    .num_layers = 3,
+    .total_layer_thickness = 3.0,
+    .num_ranks = 4,
+  };
+  tdm_result_t result = extrude_surface_mesh(config, surface_mesh,
+                                             &column_mesh);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  if (result.err_code) return;
+  result = partition_column_mesh(config, 0, NULL, surface_mesh, column_mesh);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+
+  tdm_partition_t *partition = NULL;
+  result = get_column_mesh_partition(column_mesh, &partition);
+  CHECK(!result.err_code);
+  CHECK(partition != NULL);
+  PetscInt c_start, c_end;
+  CHECK_PETSC(DMPlexGetHeightStratum(column_mesh, 0, &c_start, &c_end));
+  if (partition) {
+    CHECK(partition->num_ranks == config.num_ranks);
+    CHECK(partition->num_cells == c_end - c_start);
+  }
+  if (!partition || (partition->num_cells != c_end - c_start)) {
+    DMDestroy(&column_mesh);
+    DMDestroy(&surface_mesh);
+    return;
+  }
+  check_columns(partition, config.num_layers);
+
+  // Faces 2-4 of each prism's cone are its lateral faces.
+  for (int r = 0; r < partition->num_ranks; ++r) {
+    CHECK(partition->owned_offsets[r+1] > partition->owned_offsets[r]);
+    PetscInt num_ghosts = partition->ghost_offsets[r+1] -
+                          partition->ghost_offsets[r];
+    bool *bordered = calloc(num_ghosts + 1, sizeof(bool));
+    for (PetscInt i = partition->owned_offsets[r];
+         i < partition->owned_offsets[r+1]; ++i) {
+      PetscInt cell = partition->owned_cells[i];
+      const PetscInt *faces;
+      CHECK_PETSC(DMPlexGetCone(column_mesh, c_start + cell, &faces));
+      for (int f = 2; f < TDM_PRISM_NUM_FACES; ++f) {
+        const PetscInt *support;
+        PetscInt support_size;
+        CHECK_PETSC(DMPlexGetSupportSize(column_mesh, faces[f],
+                                         &support_size));
+        CHECK_PETSC(DMPlexGetSupport(column_mesh, faces[f], &support));
+        for (PetscInt s = 0; s < support_size; ++s) {
+          PetscInt neighbor = support[s] - c_start;
+          if ((neighbor == cell) || (partition->cell_owners[neighbor] == r)) {
+            continue;
+          }
+          CHECK(neighbor % config.num_layers == cell % config.num_layers);
+          CHECK(is_ghost(partition, r, neighbor));
+          for (PetscInt g = 0; g < num_ghosts; ++g) {
+            PetscInt j = partition->ghost_offsets[r] + g;
+            if (partition->ghost_cells[j] == neighbor) bordered[g] = true;
+          }
+        }
+      }
+    }
+    for (PetscInt g = 0; g < num_ghosts; ++g) {
+      CHECK(bordered[g]);
+    }
+    free(bordered);
+  }
+
+  DMDestroy(&column_mesh);
+  DMDestroy(&surface_mesh);
+}
+
+int main(int argc, char **argv) {
+  CHECK_PETSC(PetscInitialize(&argc, &argv, NULL, NULL));
+
+  test_strip();
+  test_column_mesh();
+
+  PetscFinalize();
+
+  return test_summary(argv[0]);
+}
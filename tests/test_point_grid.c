@@ -0,0 +1,97 @@
+// This program checks the nearest-point search of tdm_point_grid_t against a
+// brute-force search, for random points scattered uniformly, in clusters
+// (which leave most buckets empty), and along a line, and for query locations
+// inside and outside the points' bounding box.
+
+#include "point_grid.h"
+#include "tdm_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_POINTS  2000
+#define NUM_QUERIES 2000
+
+// The ways in which the test points are scattered.
+typedef enum {
+  UNIFORM,
+  CLUSTERED,
+  LINE
+} scatter_t;
+
+// Returns a random number in [a, b).
+static real_t random_real(real_t a, real_t b) {
+  return a + (b - a) * (rand() / (RAND_MAX + 1.0));
+}
+
+// Returns the squared distance between the given point and (x, y).
+static real_t dist2(const point_t *p, real_t x, real_t y) {
+  return (p->x - x) * (p->x - x) + (p->y - y) * (p->y - y);
+}
+
+// Scatters the given number of points in the given way within [0, 1000) x
+// [0, 500).
+static void scatter_points(scatter_t scatter, size_t n, point_t points[n]) {
+  real_t cx[3] = {50.0, 700.0, 990.0}, cy[3] = {20.0, 250.0, 480.0};
+  for (size_t p = 0; p < n; ++p) {
+    points[p] = (point_t){.mask = 1, .cost = 1.0};
+    if (scatter == UNIFORM) {
+      points[p].x = random_real(0.0, 1000.0);
+      points[p].y = random_real(0.0, 500.0);
+    } else if (scatter == CLUSTERED) {
+      int c = rand() % 3;
+      points[p].x = cx[c] + random_real(-5.0, 5.0);
+      points[p].y = cy[c] + random_real(-5.0, 5.0);
+    } else { // LINE
+      points[p].x = random_real(0.0, 1000.0);
+      points[p].y = 250.0;
+    }
+  }
+}
+
+// Checks the grid's nearest points against a brute-force search.
+static void test_nearest(scatter_t scatter) {
+  static point_t points[NUM_POINTS];
+  scatter_points(scatter, NUM_POINTS, points);
+  tdm_point_grid_t grid;
+  tdm_point_grid_build(NUM_POINTS, points, &grid);
+
+  int num_wrong = 0;
+  for (int q = 0; q < NUM_QUERIES; ++q) {
+    // Some queries fall outside the points' bounding box.
+    real_t x = random_real(-200.0, 1200.0), y = random_real(-200.0, 700.0);
+    size_t nearest = tdm_point_grid_nearest(&grid, points, x, y);
+    real_t min_dist2 = dist2(&points[0], x, y);
+    for (size_t p = 1; p < NUM_POINTS; ++p) {
+      real_t d2 = dist2(&points[p], x, y);
+      if (min_dist2 > d2) min_dist2 = d2;
+    }
+    // Ties may be broken either way, so we compare distances.
+    if ((nearest >= NUM_POINTS) ||
+        (dist2(&points[nearest], x, y) != min_dist2)) {
+      ++num_wrong;
+    }
+  }
+  if (num_wrong) {
+    fprintf(stderr, "scatter %d: %d wrong nearest points\n", scatter,
+            num_wrong);
+  }
+  CHECK(num_wrong == 0);
+
+  tdm_point_grid_destroy(&grid);
+}
+
+int main(int argc, char **argv) {
+  srand(12345);
+  test_nearest(UNIFORM);
+  test_nearest(CLUSTERED);
+  test_nearest(LINE);
+
+  // An empty grid gives index 0.
+  tdm_point_grid_t grid;
+  tdm_point_grid_build(0, NULL, &grid);
+  CHECK(tdm_point_grid_nearest(&grid, NULL, 1.0, 2.0) == 0);
+  tdm_point_grid_destroy(&grid);
+
+  return test_summary(argv[0]);
+}
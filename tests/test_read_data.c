@@ -0,0 +1,163 @@
+// This program checks that numbers are parsed correctly from multi-MiB text
+// rasters, plain and gzipped, whose tokens straddle the boundaries between the
+// chunks in which the rasters are streamed.
+
+#include "stream.h"
+#include "tdm.h"
+#include "tdm_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// The raster used in these tests has NUM_ROWS x NUM_COLS values, which take up
+// about 4 MiB of text.
+#define NUM_ROWS 500
+#define NUM_COLS 1000
+
+// The longest token tdm accepts (TDM_MAX_TOKEN_LEN in tdm.c).
+#define MAX_TOKEN_LEN 128
+
+// Formats the value at row i and column j of the raster into s, returning its
+// length. The lengths of the values vary so that they fall across chunk
+// boundaries in many different ways, and every 7th value is zero.
+static int format_value(char *s, int i, int j) {
+  int k = i * NUM_COLS + j;
+  return sprintf(s, "%.*f", k % 9, (k % 7) ? (k % 1013) * 1.25 : 0.0);
+}
+
+// Creates a new temporary file, storing its name in file.
+static FILE *create_file(char file[]) {
+  strcpy(file, "/tmp/tdm_test_XXXXXX");
+  return fdopen(mkstemp(file), "w");
+}
+
+// Writes the given text to a new temporary file, compressing it with gzip if
+// requested, and storing the file's name in file.
+static void write_text(const char *text, size_t size, bool gzip, char file[]) {
+  FILE *f = create_file(file);
+  if (gzip) {
+    fclose(f);
+    gzFile gz = gzopen(file, "wb1");
+    gzwrite(gz, text, (unsigned int)size);
+    gzclose(gz);
+  } else {
+    fwrite(text, 1, size, f);
+    fclose(f);
+  }
+}
+
+// Reads the points from the given file, using it for all the data of the
+// points.
+static tdm_result_t read_points(const char *file,
+                                size_t     *num_points,
+                                point_t   **points) {
+  tdm_config_t config = {
+    .dem_file = file, .lat_file = file, .lon_file = file, .mask_file = file
+  };
+  return extract_points(config, num_points, points);
+}
+
+// Checks that the raster is read intact by extract_points and scanned
+// correctly by estimate_resources.
+static void test_raster(bool gzip) {
+  char *text = malloc((size_t)NUM_ROWS * NUM_COLS * 16);
+  size_t size = 0, num_nonzero = 0;
+  real_t sum = 0.0;
+  size += sprintf(text, "raster values\n"); // a header, which is skipped
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    for (int j = 0; j < NUM_COLS; ++j) {
+      int length = format_value(&text[size], i, j);
+      real_t value = strtod(&text[size], NULL);
+      sum += value;
+      if (value != 0.0) ++num_nonzero;
+      size += length;
+      text[size++] = (j < NUM_COLS - 1) ? ' ' : '\n';
+    }
+  }
+  CHECK(size > 3 * TDM_STREAM_BUFFER_SIZE);
+  char file[32];
+  write_text(text, size, gzip, file);
+  free(text);
+
+  size_t num_points;
+  point_t *points;
+  tdm_result_t result = read_points(file, &num_points, &points);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  CHECK(num_points == NUM_ROWS * NUM_COLS);
+  if (!result.err_code && (num_points == NUM_ROWS * NUM_COLS)) {
+    real_t points_sum = 0.0;
+    size_t num_masked = 0;
+    for (size_t p = 0; p < num_points; ++p) {
+      points_sum += points[p].z;
+      num_masked += points[p].mask;
+    }
+    CHECK(points_sum == sum);
+    CHECK(num_masked == num_nonzero);
+  }
+  free(points);
+
+  tdm_config_t config = {
+    .mask_file = file, .lat_file = file, .lon_file = file, .num_layers = 1
+  };
+  config.jigsaw._hfun_scal = JIGSAW_HFUN_RELATIVE;
+  config.jigsaw._hfun_hmax = 0.1;
+  tdm_estimate_t estimate;
+  result = estimate_resources(config, &estimate);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  CHECK(estimate.num_rows == NUM_ROWS);
+  CHECK(estimate.num_cols == NUM_COLS);
+  CHECK(estimate.num_masked_points == num_nonzero);
+  unlink(file);
+}
+
+// Checks that a token of the maximum length is accepted when it ends exactly
+// at a chunk boundary, and that a longer one is rejected.
+static void test_long_token(void) {
+  for (int extra = 0; extra <= 1; ++extra) {
+    // Fill the first chunk with short values, up to a token that ends on the
+    // boundary (or one character past it).
+    size_t fill = TDM_STREAM_BUFFER_SIZE - MAX_TOKEN_LEN;
+    char *text = malloc(TDM_STREAM_BUFFER_SIZE + 16);
+    for (size_t i = 0; i < fill; i += 2) {
+      text[i] = '2';
+      text[i+1] = ' ';
+    }
+    size_t size = fill;
+    text[size++] = '1';
+    text[size++] = '.';
+    while (size < TDM_STREAM_BUFFER_SIZE + extra) text[size++] = '0';
+    size += sprintf(&text[size], "\n3\n");
+    char file[32];
+    write_text(text, size, false, file);
+    free(text);
+
+    size_t num_points;
+    point_t *points;
+    tdm_result_t result = read_points(file, &num_points, &points);
+    if (extra) {
+      CHECK(result.err_code);
+    } else {
+      if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+      CHECK(!result.err_code);
+      CHECK(num_points == fill/2 + 2);
+      if (!result.err_code && (num_points == fill/2 + 2)) {
+        CHECK(points[num_points-2].z == 1.0);
+        CHECK(points[num_points-1].z == 3.0);
+      }
+    }
+    free(points);
+    unlink(file);
+  }
+}
+
+int main(int argc, char **argv) {
+  test_raster(false);
+  test_raster(true);
+  test_long_token();
+  return test_summary(argv[0]);
+}
@@ -0,0 +1,199 @@
+// This program checks that each block of a tdm input file is read into the
+// corresponding fields of tdm_config_t, and that malformed input is rejected.
+
+#include "read_yaml.h"
+#include "tdm_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Writes the given YAML text to a temporary file and reads a configuration
+// from it.
+static tdm_result_t read_yaml_text(const char *yaml, tdm_config_t *config) {
+  char file[] = "/tmp/tdm_test_XXXXXX";
+  int fd = mkstemp(file);
+  if (fd == -1) {
+    return tdm_result(1, "Could not create a temporary input file.");
+  }
+  FILE *f = fdopen(fd, "w");
+  fputs(yaml, f);
+  fclose(f);
+
+  *config = (tdm_config_t){};
+  tdm_result_t result = read_yaml(file, config);
+  unlink(file);
+  return result;
+}
+
+static void test_partitioning(void) {
+  tdm_config_t config;
+  tdm_result_t result = read_yaml_text(
+    "partitioning:\n"
+    "  ranks: 64\n", &config);
+  CHECK(!result.err_code);
+  CHECK(config.num_ranks == 64);
+  CHECK(!config.column_cost_file);
+  CHECK(!config.compare_partitions);
+
+  result = read_yaml_text(
+    "partitioning:\n"
+    "  ranks: 8\n"
+    "  column_costs: cost.txt\n"
+    "  compare: true\n", &config);
+  CHECK(!result.err_code);
+  CHECK(config.num_ranks == 8);
+  CHECK(config.column_cost_file &&
+        !strcmp(config.column_cost_file, "cost.txt"));
+  CHECK(config.compare_partitions);
+
+  result = read_yaml_text(
+    "partitioning:\n"
+    "  compare: maybe\n", &config);
+  CHECK(result.err_code);
+
+  result = read_yaml_text(
+    "partitioning:\n"
+    "  ranks: 64x\n", &config);
+  CHECK(result.err_code);
+
+  result = read_yaml_text(
+    "partitioning:\n"
+    "  ranks: 0\n", &config);
+  CHECK(result.err_code);
+
+  result = read_yaml_text(
+    "partitioning:\n"
+    "  rank: 64\n", &config);
+  CHECK(result.err_code);
+
+  result = read_yaml_text(
+    "partitioning:\n"
+    "  ranks: 64\n"
+    "  ranks: 32\n", &config);
+  CHECK(result.err_code);
+}
+
+static void test_jigsaw(void) {
+  tdm_config_t config;
+  tdm_result_t result = read_yaml_text(
+    "jigsaw:\n"
+    "  verbosity: 1\n"
+    "  hfun_scal: 1\n"
+    "  hfun_hmax: 250.0\n"
+    "  mesh_siz1: 1.5\n"
+    "  optm_zip: 0\n", &config);
+  CHECK(!result.err_code);
+  CHECK(config.jigsaw._verbosity == 1);
+  CHECK(config.jigsaw._hfun_scal == 1);
+  CHECK(config.jigsaw._hfun_hmax == 250.0);
+  CHECK(config.jigsaw._mesh_siz1 == 1.5);
+  CHECK(config.jigsaw._optm_zip_ == 0);
+
+  // Jigsaw's defaults apply to settings that aren't given.
+  result = read_yaml_text(
+    "extrusion:\n"
+    "  layers: 10\n", &config);
+  CHECK(!result.err_code);
+  CHECK(config.num_layers == 10);
+  CHECK(config.jigsaw._hfun_hmax > 0.0);
+
+  result = read_yaml_text(
+    "jigsaw:\n"
+    "  mesh_siz1: 4.0/3.0\n", &config);
+  CHECK(result.err_code);
+}
+
+static void test_output(void) {
+  tdm_config_t config;
+  tdm_result_t result = read_yaml_text(
+    "output:\n"
+    "  surface_mesh:\n"
+    "    format: exodus\n"
+    "    filename: surface.exo\n"
+    "  column_mesh:\n"
+    "    format: hdf5\n"
+    "    filename: columns.h5\n"
+    "    fv_geometry: true\n"
+    "extrusion:\n"
+    "  layers: 4\n", &config);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  CHECK(config.surface_mesh_format == TDM_EXODUS);
+  CHECK(config.surface_mesh_file &&
+        !strcmp(config.surface_mesh_file, "surface.exo"));
+  CHECK(config.column_mesh_format == TDM_HDF5);
+  CHECK(config.column_mesh_file &&
+        !strcmp(config.column_mesh_file, "columns.h5"));
+  CHECK(config.column_mesh_fv_geometry);
+  CHECK(config.num_layers == 4); // the next block is still read
+
+  result = read_yaml_text(
+    "output:\n"
+    "  surface_mesh:\n"
+    "    fv_geometry: true\n", &config);
+  CHECK(result.err_code);
+
+  result = read_yaml_text(
+    "output:\n"
+    "  column_mesh: columns.exo\n", &config);
+  CHECK(result.err_code);
+}
+
+static void test_decimation(void) {
+  tdm_config_t config;
+  tdm_result_t result = read_yaml_text(
+    "decimation:\n"
+    "  max_error: 2.5\n"
+    "  min_angle: 20\n"
+    "extrusion:\n"
+    "  layers: 4\n", &config);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  CHECK(config.decimation_max_error == 2.5);
+  CHECK(config.decimation_min_angle == 20.0);
+  CHECK(config.num_layers == 4);
+
+  // Without a decimation block, the surface mesh is left alone.
+  result = read_yaml_text("extrusion:\n  layers: 4\n", &config);
+  CHECK(!result.err_code);
+  CHECK(config.decimation_max_error == 0.0);
+
+  const char *bad_blocks[] = {
+    "decimation:\n  max_error: 0\n",
+    "decimation:\n  max_error: 2m\n",
+    "decimation:\n  min_angle: 60\n",
+    "decimation:\n  min_angle: -1\n",
+    "decimation:\n  max_err: 2.0\n",
+    "decimation:\n  max_error: 2.0\n  max_error: 3.0\n",
+  };
+  for (size_t i = 0; i < sizeof(bad_blocks)/sizeof(bad_blocks[0]); ++i) {
+    result = read_yaml_text(bad_blocks[i], &config);
+    CHECK(result.err_code);
+  }
+}
+
+// Reads the given example input file, which should be accepted as is.
+static void test_example(const char *yaml_file) {
+  tdm_config_t config = {};
+  tdm_result_t result = read_yaml(yaml_file, &config);
+  if (result.err_code) fprintf(stderr, "%s\n", result.err_msg);
+  CHECK(!result.err_code);
+  CHECK(config.dem_file && !strcmp(config.dem_file, "DEM.txt"));
+  CHECK(config.jigsaw._hfun_hmax == 0.02);
+  CHECK(config.num_layers == 100);
+  CHECK(config.column_mesh_file &&
+        !strcmp(config.column_mesh_file, "columns.exo"));
+  CHECK(config.column_mesh_fv_geometry);
+}
+
+// Usage: test_read_yaml [example.yaml]
+int main(int argc, char **argv) {
+  test_partitioning();
+  test_jigsaw();
+  test_output();
+  test_decimation();
+  if (argc > 1) test_example(argv[1]);
+  return test_summary(argv[0]);
+}
@@ -0,0 +1,133 @@
+// This program checks that tdm_stream_t delivers the exact contents of plain
+// and compressed files, and that it detects truncated compressed files.
+
+#include "stream.h"
+#include "tdm_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef TDM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Generates a few MiB of (very compressible) text, so that streams span
+// several buffers. The text ends a little past a buffer boundary, inside the
+// last compressed block, so the decoder has to fill a buffer partway through
+// that block.
+static char *make_text(size_t *size) {
+  *size = (3 << 20) + 50000;
+  char *text = malloc(*size + 64);
+  size_t length = 0;
+  for (int i = 0; length < *size; ++i) {
+    length += snprintf(&text[length], 64, "%d %d 0 0 0 0\n", i % 1000, i % 7);
+  }
+  return text;
+}
+
+// Creates a new temporary file, storing its name in file.
+static FILE *create_file(char file[]) {
+  strcpy(file, "/tmp/tdm_test_XXXXXX");
+  return fdopen(mkstemp(file), "wb");
+}
+
+// Writes the given text to a gzip file, as the given number of members.
+static void write_gzip(const char *file, const char *text, size_t size,
+                       int num_members) {
+  size_t member_size = size / num_members;
+  for (int m = 0; m < num_members; ++m) {
+    size_t offset = m * member_size;
+    size_t n = (m == num_members - 1) ? size - offset : member_size;
+    gzFile gz = gzopen(file, (m == 0) ? "wb" : "ab");
+    gzwrite(gz, &text[offset], (unsigned int)n);
+    gzclose(gz);
+  }
+}
+
+// Streams the given file, checking that its contents match the given text.
+static tdm_result_t check_stream(const char *file, const char *text,
+                                 size_t size) {
+  tdm_stream_t *stream;
+  tdm_result_t result = tdm_stream_open(file, &stream);
+  if (result.err_code) return result;
+  size_t offset = 0;
+  bool matches = true;
+  while (true) {
+    const char *chunk;
+    size_t chunk_size;
+    result = tdm_stream_next(stream, &chunk, &chunk_size);
+    if (result.err_code || (chunk_size == 0)) break;
+    if ((offset + chunk_size > size) ||
+        memcmp(chunk, &text[offset], chunk_size)) {
+      matches = false;
+    }
+    offset += chunk_size;
+  }
+  tdm_stream_close(stream);
+  if (!result.err_code && (!matches || (offset != size))) {
+    result = tdm_result(1, "Contents of '%s' don't match.", file);
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  size_t size;
+  char *text = make_text(&size);
+  char file[32];
+  tdm_result_t result;
+
+  // plain text
+  FILE *f = create_file(file);
+  fwrite(text, 1, size, f);
+  fclose(f);
+  result = check_stream(file, text, size);
+  CHECK(!result.err_code);
+  unlink(file);
+
+  // gzip, with one member and with several
+  for (int num_members = 1; num_members <= 3; num_members += 2) {
+    fclose(create_file(file));
+    write_gzip(file, text, size, num_members);
+    result = check_stream(file, text, size);
+    CHECK(!result.err_code);
+    unlink(file);
+  }
+
+  // truncated gzip
+  fclose(create_file(file));
+  write_gzip(file, text, size, 1);
+  f = fopen(file, "rb");
+  fseek(f, 0, SEEK_END);
+  long compressed_size = ftell(f);
+  fclose(f);
+  CHECK(truncate(file, compressed_size - 16) == 0);
+  result = check_stream(file, text, size);
+  CHECK(result.err_code);
+  unlink(file);
+
+#ifdef TDM_HAVE_ZSTD
+  // zstd, without a checksum, and truncated
+  size_t capacity = ZSTD_compressBound(size);
+  char *compressed = malloc(capacity);
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 0);
+  size_t compressed_len = ZSTD_compress2(cctx, compressed, capacity, text,
+                                         size);
+  ZSTD_freeCCtx(cctx);
+  CHECK(!ZSTD_isError(compressed_len));
+  for (int truncated = 0; truncated <= 1; ++truncated) {
+    f = create_file(file);
+    fwrite(compressed, 1, compressed_len - 16 * truncated, f);
+    fclose(f);
+    result = check_stream(file, text, size);
+    CHECK((result.err_code != 0) == truncated);
+    unlink(file);
+  }
+  free(compressed);
+#endif
+
+  free(text);
+  return test_summary(argv[0]);
+}